@@ -0,0 +1,80 @@
+#include "barrier.h"
+
+namespace
+{
+	using Stage = vk::PipelineStageFlagBits2;
+	using AccessBits = vk::AccessFlagBits2;
+	using Layout = renderer::Texture::Layout;
+
+	constexpr vk::AccessFlags2 write_accesses = AccessBits::eShaderWrite | AccessBits::eShaderStorageWrite
+		| AccessBits::eColorAttachmentWrite | AccessBits::eDepthStencilAttachmentWrite | AccessBits::eTransferWrite
+		| AccessBits::eHostWrite | AccessBits::eMemoryWrite;
+}
+
+bool renderer::AccessInfo::is_write() const
+{
+	return static_cast<bool>( access & write_accesses );
+}
+
+renderer::AccessInfo renderer::get_access_info( Access access )
+{
+	switch ( access )
+	{
+		case Access::NONE:
+			return { Stage::eNone, AccessBits::eNone, Layout::UNDEFINED };
+		case Access::COLOR_ATTACHMENT_WRITE:
+			// Includes reads for load ops and blending
+			return { Stage::eColorAttachmentOutput,
+					 AccessBits::eColorAttachmentWrite | AccessBits::eColorAttachmentRead,
+					 Layout::COLOR_ATTACHMENT_OPTIMAL };
+		case Access::DEPTH_ATTACHMENT_WRITE:
+			return { Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+					 AccessBits::eDepthStencilAttachmentWrite | AccessBits::eDepthStencilAttachmentRead,
+					 Layout::DEPTH_ATTACHMENT_OPTIMAL };
+		case Access::DEPTH_ATTACHMENT_READ:
+			return { Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+					 AccessBits::eDepthStencilAttachmentRead,
+					 Layout::DEPTH_READ_ONLY_OPTIMAL };
+		case Access::VERTEX_SHADER_READ:
+			return { Stage::eVertexShader, AccessBits::eShaderSampledRead | AccessBits::eShaderStorageRead, Layout::SHADER_READ_ONLY_OPTIMAL };
+		case Access::TASK_MESH_SHADER_READ:
+			return { Stage::eTaskShaderEXT | Stage::eMeshShaderEXT,
+					 AccessBits::eShaderSampledRead | AccessBits::eShaderStorageRead,
+					 Layout::SHADER_READ_ONLY_OPTIMAL };
+		case Access::FRAGMENT_SHADER_READ:
+			return { Stage::eFragmentShader,
+					 AccessBits::eShaderSampledRead | AccessBits::eShaderStorageRead,
+					 Layout::SHADER_READ_ONLY_OPTIMAL };
+		case Access::COMPUTE_SHADER_READ:
+			return { Stage::eComputeShader,
+					 AccessBits::eShaderSampledRead | AccessBits::eShaderStorageRead,
+					 Layout::SHADER_READ_ONLY_OPTIMAL };
+		case Access::ANY_SHADER_READ:
+			return { Stage::eVertexShader | Stage::eFragmentShader | Stage::eComputeShader,
+					 AccessBits::eShaderSampledRead | AccessBits::eShaderStorageRead,
+					 Layout::SHADER_READ_ONLY_OPTIMAL };
+		case Access::COMPUTE_STORAGE_READ:
+			return { Stage::eComputeShader, AccessBits::eShaderStorageRead, Layout::GENERAL };
+		case Access::COMPUTE_STORAGE_WRITE:
+			return { Stage::eComputeShader, AccessBits::eShaderStorageWrite, Layout::GENERAL };
+		case Access::COMPUTE_STORAGE_READ_WRITE:
+			return { Stage::eComputeShader, AccessBits::eShaderStorageRead | AccessBits::eShaderStorageWrite, Layout::GENERAL };
+		case Access::FRAGMENT_STORAGE_WRITE:
+			return { Stage::eFragmentShader, AccessBits::eShaderStorageWrite, Layout::GENERAL };
+		case Access::INDIRECT_READ:
+			return { Stage::eDrawIndirect, AccessBits::eIndirectCommandRead, Layout::UNDEFINED };
+		case Access::INDEX_READ:
+			return { Stage::eIndexInput, AccessBits::eIndexRead, Layout::UNDEFINED };
+		case Access::TRANSFER_READ:
+			return { Stage::eAllTransfer, AccessBits::eTransferRead, Layout::TRANSFER_SRC_OPTIMAL };
+		case Access::TRANSFER_WRITE:
+			return { Stage::eAllTransfer, AccessBits::eTransferWrite, Layout::TRANSFER_DST_OPTIMAL };
+		case Access::HOST_WRITE:
+			return { Stage::eHost, AccessBits::eHostWrite, Layout::GENERAL };
+		case Access::PRESENT:
+			// Presentation is synchronized by semaphores, the barrier only needs to do the layout transition
+			return { Stage::eNone, AccessBits::eNone, Layout::PRESENT_SRC };
+		default:
+			throw Error( "invalid access type" );
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <renderer/common.h>
+#include <renderer/texture.h>
+
+namespace renderer
+{
+	// How a command uses a resource. Barriers derive their stage/access masks and image layout from it.
+	enum class Access
+	{
+		NONE, // Nothing happened yet or previous content can be discarded
+		COLOR_ATTACHMENT_WRITE,
+		DEPTH_ATTACHMENT_WRITE,
+		DEPTH_ATTACHMENT_READ,
+		// Sampled images and storage buffers
+		VERTEX_SHADER_READ,
+		TASK_MESH_SHADER_READ, // Only valid if the device supports mesh shaders
+		FRAGMENT_SHADER_READ,
+		COMPUTE_SHADER_READ,
+		ANY_SHADER_READ, // Vertex, fragment and compute
+		// Storage images and storage buffers
+		COMPUTE_STORAGE_READ,
+		COMPUTE_STORAGE_WRITE,
+		COMPUTE_STORAGE_READ_WRITE,
+		FRAGMENT_STORAGE_WRITE,
+		INDIRECT_READ,
+		INDEX_READ,
+		TRANSFER_READ,
+		TRANSFER_WRITE,
+		HOST_WRITE,
+		PRESENT
+	};
+
+	struct AccessInfo
+	{
+		vk::PipelineStageFlags2 stages;
+		vk::AccessFlags2 access;
+		Texture::Layout layout = Texture::Layout::UNDEFINED; // Ignored for buffers
+
+		bool is_write() const;
+		bool operator==( const AccessInfo& other ) const = default;
+	};
+
+	AccessInfo get_access_info( Access access );
+
+	struct Transition
+	{
+		Access src;
+		Access dst;
+	};
+
+	// Common transitions
+	namespace transition
+	{
+		inline constexpr Transition UNDEFINED_TO_COLOR_ATTACHMENT { Access::NONE, Access::COLOR_ATTACHMENT_WRITE };
+		inline constexpr Transition UNDEFINED_TO_DEPTH_ATTACHMENT { Access::NONE, Access::DEPTH_ATTACHMENT_WRITE };
+		inline constexpr Transition UNDEFINED_TO_TRANSFER_WRITE { Access::NONE, Access::TRANSFER_WRITE };
+		inline constexpr Transition COLOR_ATTACHMENT_TO_SAMPLED { Access::COLOR_ATTACHMENT_WRITE, Access::FRAGMENT_SHADER_READ };
+		inline constexpr Transition COLOR_ATTACHMENT_TO_PRESENT { Access::COLOR_ATTACHMENT_WRITE, Access::PRESENT };
+		inline constexpr Transition DEPTH_ATTACHMENT_TO_SAMPLED { Access::DEPTH_ATTACHMENT_WRITE, Access::ANY_SHADER_READ };
+		inline constexpr Transition COMPUTE_WRITE_TO_COMPUTE_READ { Access::COMPUTE_STORAGE_WRITE, Access::COMPUTE_SHADER_READ };
+		inline constexpr Transition COMPUTE_WRITE_TO_SHADER_READ { Access::COMPUTE_STORAGE_WRITE, Access::ANY_SHADER_READ };
+		inline constexpr Transition COMPUTE_WRITE_TO_INDIRECT_READ { Access::COMPUTE_STORAGE_WRITE, Access::INDIRECT_READ };
+		inline constexpr Transition TRANSFER_WRITE_TO_SAMPLED { Access::TRANSFER_WRITE, Access::ANY_SHADER_READ };
+		inline constexpr Transition TRANSFER_WRITE_TO_COMPUTE_WRITE { Access::TRANSFER_WRITE, Access::COMPUTE_STORAGE_WRITE };
+	}
+
+	namespace details
+	{
+		// Last access of each mip of a texture, as recorded by command buffers.
+		// Assumes command buffers are submitted in the order they were recorded and that a given texture
+		// isn't recorded from multiple threads at once.
+		struct TextureState
+		{
+			std::vector<AccessInfo> mips;
+		};
+	}
+
+	// Subresources covered by a texture barrier, counts of -1 mean all remaining mips/layers
+	struct TextureSubresource
+	{
+		int base_mip = 0;
+		int mip_count = -1;
+		int base_layer = 0;
+		int layer_count = -1;
+	};
+}
@@ -2,48 +2,163 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
+#include <iterator>
+#include <limits>
+#include <renderer/command_buffer.h>
+#include <renderer/details/profiler.h>
 #include <renderer/device.h>
 
-renderer::BindlessManagerBase::BindlessBuffer::BindlessBuffer( Device& device, uint32_t capacity )
+namespace
 {
-	// Use uncached memory mapped device memory if possible
-	const bool use_mmap = capacity < std::min( 1024zu * 1024, device._properties.transfer_memory_size );
-	if ( !use_mmap )
+	// Use uncached memory mapped device memory if possible, else device local memory written through copies.
+	// Descriptor buffers reference them by address.
+	renderer::raii::Buffer create_bindless_buffer( renderer::Device& device, std::size_t size )
 	{
-		// TODO: implement support for devices without BAR/ReBAR if needed
-		throw Error( "Bindless buffer can't fit into memory mappable device memory" );
+		constexpr auto usage = renderer::Buffer::Usage::STORAGE_BUFFER | renderer::Buffer::Usage::SHADER_DEVICE_ADDRESS;
+		if ( size <= std::min( 1024zu * 1024, device.get_properties().transfer_memory_size ) )
+		{
+			return device.create_buffer( usage, size, true );
+		}
+		return device.create_buffer( usage | renderer::Buffer::Usage::TRANSFER_DST, size );
 	}
-	_buffer = device.create_buffer( Buffer::Usage::STORAGE_BUFFER, capacity, true );
 }
 
-uint32_t renderer::BindlessManagerBase::BindlessBuffer::append( const void* data, uint32_t size )
+renderer::BindlessManagerBase::BindlessBuffer::BindlessBuffer( Device& device, uint32_t item_size, uint32_t capacity )
+	: _buffer( create_bindless_buffer( device, std::max( capacity, 1u ) * std::size_t( item_size ) ) )
+	, _item_size( item_size )
+	, _shadow( _buffer.get_size() )
+{
+}
+
+uint32_t renderer::BindlessManagerBase::BindlessBuffer::allocate( Device& device, uint32_t count, bool& grown )
 {
-	if ( _size + size > _buffer.get_size() )
+	grown = false;
+	auto& free_offsets = count == 1 ? _free_offsets : _free_versioned_offsets;
+	if ( !free_offsets.empty() )
 	{
-		// TODO: support geometric realloc growth?
-		throw Error( "Bindless buffer storage out of space" );
+		const auto offset = free_offsets.back();
+		free_offsets.pop_back();
+		return offset;
+	}
+
+	const auto size = count * _item_size;
+	if ( _size + size > _shadow.size() )
+	{
+		// Geometric growth, frames in flight keep reading the previous buffer until it gets deleted
+		const auto capacity = std::max( _shadow.size() * 2, std::size_t( _size ) + size );
+		if ( capacity > std::numeric_limits<uint32_t>::max() )
+		{
+			throw Error( "Bindless buffer storage out of space" );
+		}
+		auto buffer = create_bindless_buffer( device, capacity );
+		_shadow.resize( capacity );
+		if ( buffer._mapped_address )
+		{
+			memcpy( buffer.get_mapped_address(), _shadow.data(), _size );
+		}
+		else
+		{
+			// Copy everything at next flush, pending entries included
+			_dirty_offsets.clear();
+			for ( uint32_t entry = 0; entry < _size; entry += _item_size )
+			{
+				_dirty_offsets.push_back( entry );
+			}
+		}
+		device.queue_deletion( std::move( _buffer ) );
+		_buffer = std::move( buffer );
+		grown = true;
 	}
 	const auto offset = _size;
-	memcpy( static_cast<std::byte*>( _buffer.get_mapped_address() ) + offset, data, size );
 	_size += size;
 	return offset;
 }
 
-renderer::BindlessManagerBase::BindlessManagerBase( Device& device, std::span<const uint32_t> buffer_capacities )
+void renderer::BindlessManagerBase::BindlessBuffer::write( uint32_t offset, const void* data )
+{
+	memcpy( _shadow.data() + offset, data, _item_size );
+	if ( is_mapped() )
+	{
+		memcpy( static_cast<std::byte*>( _buffer.get_mapped_address() ) + offset, data, _item_size );
+	}
+	else
+	{
+		_dirty_offsets.push_back( offset );
+	}
+}
+
+void renderer::BindlessManagerBase::BindlessBuffer::update( uint32_t offset, uint32_t frame_index, const void* data )
+{
+	write( offset + frame_index * _item_size, data );
+	// Other versions catch up when their frame comes
+	for ( uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; ++frame )
+	{
+		if ( frame != frame_index )
+		{
+			_stale_versions[ frame ].push_back( offset );
+		}
+	}
+}
+
+void renderer::BindlessManagerBase::BindlessBuffer::refresh( uint32_t frame_index )
+{
+	// The previous frame's version is always up to date, it was refreshed when that frame began then updated
+	const auto previous = ( frame_index + MAX_FRAMES_IN_FLIGHT - 1 ) % MAX_FRAMES_IN_FLIGHT;
+	auto& stale = _stale_versions[ frame_index ];
+	for ( const auto offset : stale )
+	{
+		write( offset + frame_index * _item_size, _shadow.data() + offset + previous * _item_size );
+	}
+	stale.clear();
+}
+
+void renderer::BindlessManagerBase::BindlessBuffer::remove( uint32_t offset, uint32_t frame_index, bool versioned )
+{
+	assert( offset % _item_size == 0 && offset < _size );
+	( versioned ? _pending_versioned_frees : _pending_frees )[ frame_index ].push_back( offset );
+}
+
+void renderer::BindlessManagerBase::BindlessBuffer::recycle( uint32_t frame_index )
+{
+	auto& pending = _pending_frees[ frame_index ];
+	_free_offsets.insert( end( _free_offsets ), begin( pending ), end( pending ) );
+	pending.clear();
+
+	auto& pending_versioned = _pending_versioned_frees[ frame_index ];
+	_free_versioned_offsets.insert( end( _free_versioned_offsets ), begin( pending_versioned ), end( pending_versioned ) );
+	pending_versioned.clear();
+}
+
+renderer::BindlessManagerBase::BindlessManagerBase( Device& device,
+														 std::span<const uint32_t> item_sizes,
+														 std::span<const uint32_t> capacities,
+														 const Desc& desc )
 	: _device( &device )
+	, _backend( desc.backend )
+	, _max_textures( std::min( desc.max_textures, device.get_properties().max_bindless_textures ) )
 {
-	_samplers.reserve( 2 );
+	if ( _backend == Backend::DESCRIPTOR_BUFFER && !device.get_properties().descriptor_buffer_support )
+	{
+		throw Error( "Descriptor buffers are not supported by the device" );
+	}
+	// Descriptor buffers can be written at any time, their layouts don't take update after bind flags
+	_update_after_bind = _backend == Backend::DESCRIPTOR_SETS && device.get_properties().update_after_bind_support;
+
+	_samplers.reserve( 3 );
 	_samplers.push_back( device.create_sampler( Sampler::Filter::LINEAR ) );
 	if ( device.get_properties().minmax_filter_support )
 	{
 		_samplers.push_back( device.create_sampler( Sampler::Filter::LINEAR, Sampler::ReductionMode::MIN ) );
+		_samplers.push_back( device.create_sampler( Sampler::Filter::LINEAR, Sampler::ReductionMode::MAX ) );
 	}
 
-	_buffers.reserve( buffer_capacities.size() );
-	for ( const auto capacity : buffer_capacities )
+	assert( item_sizes.size() == capacities.size() );
+	_buffers.reserve( capacities.size() );
+	for ( std::size_t i = 0; i < capacities.size(); ++i )
 	{
-		_buffers.emplace_back( device, capacity );
+		_buffers.emplace_back( device, item_sizes[ i ], capacities[ i ] );
 	}
 
 	// TODO: let user decide which stages the bindless manager can used with?
@@ -53,11 +168,11 @@ renderer::BindlessManagerBase::BindlessManagerBase( Device& device, std::span<co
 	const std::array<vk::DescriptorSetLayoutBinding, std::to_underlying( TextureBindings::COUNT )> texture_bindings {
 		{ { .binding = std::to_underlying( TextureBindings::TEXTURES ),
 			.descriptorType = vk::DescriptorType::eSampledImage,
-			.descriptorCount = MAX_TEXTURES,
+			.descriptorCount = _max_textures,
 			.stageFlags = stages },
 		  { .binding = std::to_underlying( TextureBindings::IMAGES ),
 			.descriptorType = vk::DescriptorType::eStorageImage,
-			.descriptorCount = MAX_TEXTURES,
+			.descriptorCount = _max_textures,
 			.stageFlags = stages },
 		  { .binding = std::to_underlying( TextureBindings::SAMPLERS ),
 			.descriptorType = vk::DescriptorType::eSampler,
@@ -65,8 +180,29 @@ renderer::BindlessManagerBase::BindlessManagerBase( Device& device, std::span<co
 			.stageFlags = stages } }
 	};
 
+	auto layout_flags = _backend == Backend::DESCRIPTOR_BUFFER ? vk::DescriptorSetLayoutCreateFlagBits::eDescriptorBufferEXT
+															   : vk::DescriptorSetLayoutCreateFlags {};
+	vk::DescriptorBindingFlags binding_flags;
+	if ( device.get_properties().update_after_bind_support )
+	{
+		binding_flags |= vk::DescriptorBindingFlagBits::ePartiallyBound;
+	}
+	if ( _update_after_bind )
+	{
+		layout_flags |= vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
+		binding_flags |= vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+	}
+	// Only the last binding of a set can have a variable count, which would be the samplers. Texture arrays are sized
+	// by Desc::max_textures instead.
+	const std::vector<vk::DescriptorBindingFlags> texture_binding_flags( texture_bindings.size(), binding_flags );
+	const vk::DescriptorSetLayoutBindingFlagsCreateInfo texture_flags_info {
+		.bindingCount = static_cast<uint32_t>( texture_binding_flags.size() ),
+		.pBindingFlags = texture_binding_flags.data()
+	};
 	_layouts[ std::to_underlying( Sets::TEXTURES ) ] = device._device.createDescriptorSetLayout(
-		vk::DescriptorSetLayoutCreateInfo { .bindingCount = static_cast<uint32_t>( texture_bindings.size() ),
+		vk::DescriptorSetLayoutCreateInfo { .pNext = &texture_flags_info,
+											.flags = layout_flags,
+											.bindingCount = static_cast<uint32_t>( texture_bindings.size() ),
 											.pBindings = texture_bindings.data() } );
 
 	std::vector<vk::DescriptorSetLayoutBinding> buffer_bindings;
@@ -76,130 +212,608 @@ renderer::BindlessManagerBase::BindlessManagerBase( Device& device, std::span<co
 			{ .binding = i, .descriptorType = vk::DescriptorType::eStorageBuffer, .descriptorCount = 1, .stageFlags = stages } );
 	}
 
+	const std::vector<vk::DescriptorBindingFlags> buffer_binding_flags( buffer_bindings.size(), binding_flags );
+	const vk::DescriptorSetLayoutBindingFlagsCreateInfo buffer_flags_info {
+		.bindingCount = static_cast<uint32_t>( buffer_binding_flags.size() ),
+		.pBindingFlags = buffer_binding_flags.data()
+	};
 	_layouts[ std::to_underlying( Sets::BUFFERS ) ] = device._device.createDescriptorSetLayout(
-		vk::DescriptorSetLayoutCreateInfo { .bindingCount = static_cast<uint32_t>( buffer_bindings.size() ),
+		vk::DescriptorSetLayoutCreateInfo { .pNext = &buffer_flags_info,
+											.flags = layout_flags,
+											.bindingCount = static_cast<uint32_t>( buffer_bindings.size() ),
 											.pBindings = buffer_bindings.data() } );
 
-	const std::array<vk::DescriptorPoolSize, 4> pools { { { .type = vk::DescriptorType::eSampledImage, .descriptorCount = MAX_TEXTURES },
-														  { .type = vk::DescriptorType::eStorageImage, .descriptorCount = MAX_TEXTURES },
+	if ( _backend == Backend::DESCRIPTOR_BUFFER )
+	{
+		create_descriptor_buffer();
+	}
+	else
+	{
+		create_descriptor_sets();
+	}
+
+	std::vector<vk::DescriptorImageInfo> samplers_info;
+	samplers_info.reserve( _samplers.size() );
+	for ( const renderer::Sampler sampler : _samplers )
+	{
+		samplers_info.push_back( { .sampler = sampler._sampler } );
+	};
+
+	const vk::WriteDescriptorSet write { .dstSet = _texture_set,
+										 .dstBinding = std::to_underlying( TextureBindings::SAMPLERS ),
+										 .descriptorCount = static_cast<uint32_t>( samplers_info.size() ),
+										 .descriptorType = vk::DescriptorType::eSampler,
+										 .pImageInfo = samplers_info.data() };
+	write_descriptors( Sets::TEXTURES, std::span( &write, 1 ) );
+
+	for ( uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; ++frame )
+	{
+		for ( uint32_t i = 0; i < _buffers.size(); ++i )
+		{
+			write_buffer_binding( i, frame );
+		}
+	}
+}
+
+void renderer::BindlessManagerBase::create_descriptor_sets()
+{
+	const auto buffer_descriptors = static_cast<uint32_t>( _buffers.size() * MAX_FRAMES_IN_FLIGHT );
+	const std::array<vk::DescriptorPoolSize, 4> pools { { { .type = vk::DescriptorType::eSampledImage, .descriptorCount = _max_textures },
+														  { .type = vk::DescriptorType::eStorageImage, .descriptorCount = _max_textures },
 														  { .type = vk::DescriptorType::eSampler, .descriptorCount = MAX_SAMPLERS },
-														  { .type = vk::DescriptorType::eStorageBuffer,
-															.descriptorCount = static_cast<uint32_t>( _buffers.size() ) } } };
+														  { .type = vk::DescriptorType::eStorageBuffer, .descriptorCount = buffer_descriptors } } };
 	// We don't need (or want) individual descriptor set deletion but VulkanHpp RAII is all or nothing :(
-	const vk::DescriptorPoolCreateInfo pool_info { .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
-												   .maxSets = static_cast<uint32_t>( ( MAX_TEXTURES * 2 ) + MAX_SAMPLERS
-																					 + _buffers.size() ),
+	vk::DescriptorPoolCreateFlags pool_flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+	if ( _update_after_bind )
+	{
+		pool_flags |= vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind;
+	}
+	const vk::DescriptorPoolCreateInfo pool_info { .flags = pool_flags,
+												   .maxSets = static_cast<uint32_t>( ( _max_textures * 2 ) + MAX_SAMPLERS
+																					 + _buffers.size() * MAX_FRAMES_IN_FLIGHT ),
 												   .poolSizeCount = pools.size(),
 												   .pPoolSizes = pools.data() };
-	_pool = device._device.createDescriptorPool( pool_info );
+	_pool = _device->_device.createDescriptorPool( pool_info );
 
-	const auto layouts = get_layouts();
+	// One textures set, one buffers set per frame in flight
+	std::array<vk::DescriptorSetLayout, 1 + MAX_FRAMES_IN_FLIGHT> layouts;
+	layouts[ 0 ] = _layouts[ std::to_underlying( Sets::TEXTURES ) ];
+	std::fill( begin( layouts ) + 1, end( layouts ), *_layouts[ std::to_underlying( Sets::BUFFERS ) ] );
 	const vk::DescriptorSetAllocateInfo alloc_info { .descriptorPool = _pool,
-													 .descriptorSetCount = SETS_COUNT,
+													 .descriptorSetCount = static_cast<uint32_t>( layouts.size() ),
 													 .pSetLayouts = layouts.data() };
-	auto descs = device._device.allocateDescriptorSets( alloc_info );
-	assert( descs.size() == SETS_COUNT );
-	std::move( begin( descs ), end( descs ), begin( _sets ) );
+	auto descs = _device->_device.allocateDescriptorSets( alloc_info );
+	assert( descs.size() == layouts.size() );
+	_texture_set = std::move( descs[ 0 ] );
+	std::move( begin( descs ) + 1, end( descs ), begin( _buffer_sets ) );
+}
 
-	std::vector<vk::DescriptorImageInfo> samplers_info;
-	samplers_info.reserve( _samplers.size() );
-	for ( const renderer::Sampler sampler : _samplers )
+void renderer::BindlessManagerBase::create_descriptor_buffer()
+{
+	// Both sets live in the same buffer, each binding at the offset the driver picked for it
+	const auto alignment = _device->_descriptor_buffer_properties.descriptorBufferOffsetAlignment;
+	std::size_t size = 0;
+	for ( uint32_t set = 0; set < SETS_COUNT; ++set )
 	{
-		samplers_info.push_back( { .sampler = sampler._sampler } );
-	};
+		const auto& layout = _layouts[ set ];
+		_set_offsets[ set ] = ( size + alignment - 1 ) / alignment * alignment;
+		size = _set_offsets[ set ] + layout.getSizeEXT();
 
-	std::vector<vk::DescriptorBufferInfo> buffers_info( _buffers.size() );
-	std::vector<vk::WriteDescriptorSet> writes;
-	writes.reserve( 1 + _buffers.size() );
-	writes.push_back( { .dstSet = _sets[ std::to_underlying( Sets::TEXTURES ) ],
-						.dstBinding = std::to_underlying( TextureBindings::SAMPLERS ),
-						.descriptorCount = static_cast<uint32_t>( samplers_info.size() ),
-						.descriptorType = vk::DescriptorType::eSampler,
-						.pImageInfo = samplers_info.data() } );
+		const auto binding_count = set == std::to_underlying( Sets::TEXTURES ) ? std::to_underlying( TextureBindings::COUNT )
+																				: static_cast<uint32_t>( _buffers.size() );
+		_binding_offsets[ set ].resize( binding_count );
+		for ( uint32_t binding = 0; binding < binding_count; ++binding )
+		{
+			_binding_offsets[ set ][ binding ] = layout.getBindingOffsetEXT( binding );
+		}
+	}
 
-	for ( uint32_t i = 0; i < _buffers.size(); ++i )
+	// One copy per frame in flight
+	_descriptor_frame_size = ( size + alignment - 1 ) / alignment * alignment;
+	_descriptor_buffer = _device->create_buffer( Buffer::Usage::RESOURCE_DESCRIPTOR_BUFFER | Buffer::Usage::SAMPLER_DESCRIPTOR_BUFFER
+													 | Buffer::Usage::SHADER_DEVICE_ADDRESS,
+												 _descriptor_frame_size * MAX_FRAMES_IN_FLIGHT,
+												 true );
+}
+
+void renderer::BindlessManagerBase::write_descriptors( Sets set, std::span<const vk::WriteDescriptorSet> writes )
+{
+	if ( _backend == Backend::DESCRIPTOR_SETS )
 	{
-		// Should we limit the buffer range to the actual used size? Would it be worth the cost of doing a descriptor update on each append?
-		buffers_info[ i ] = { .buffer = _buffers[ i ]._buffer._buffer, .range = _buffers[ i ]._buffer.get_size() };
-		writes.push_back( { .dstSet = _sets[ std::to_underlying( Sets::BUFFERS ) ],
-							.dstBinding = i,
-							.descriptorCount = 1,
-							.descriptorType = vk::DescriptorType::eStorageBuffer,
-							.pBufferInfo = &buffers_info[ i ] } );
+		_device->_device.updateDescriptorSets( writes, {} );
+		return;
+	}
+
+	// Same writes, straight to the current frame's copy of the descriptor buffer. Frames in flight read their own copy,
+	// which gets the writes when their frame begins again (see refresh_descriptors()).
+	const auto& properties = _device->_descriptor_buffer_properties;
+	const auto set_index = std::to_underlying( set );
+	std::lock_guard lock( _descriptor_buffer_mutex );
+	auto mapped = static_cast<std::byte*>( _descriptor_buffer.get_mapped_address() ) + _frame_index * _descriptor_frame_size
+		+ _set_offsets[ set_index ];
+	std::vector<DescriptorRange> written;
+	for ( const auto& write : writes )
+	{
+		for ( uint32_t i = 0; i < write.descriptorCount; ++i )
+		{
+			vk::DescriptorGetInfoEXT info { .type = write.descriptorType };
+			vk::DescriptorAddressInfoEXT address;
+			std::size_t size = 0;
+			switch ( write.descriptorType )
+			{
+				case vk::DescriptorType::eSampledImage:
+					// Null views are only written with null descriptor support (see clear_texture_bindings())
+					info.data.pSampledImage = write.pImageInfo[ i ].imageView ? &write.pImageInfo[ i ] : nullptr;
+					size = properties.sampledImageDescriptorSize;
+					break;
+				case vk::DescriptorType::eStorageImage:
+					info.data.pStorageImage = write.pImageInfo[ i ].imageView ? &write.pImageInfo[ i ] : nullptr;
+					size = properties.storageImageDescriptorSize;
+					break;
+				case vk::DescriptorType::eSampler:
+					info.data.pSampler = &write.pImageInfo[ i ].sampler;
+					size = properties.samplerDescriptorSize;
+					break;
+				case vk::DescriptorType::eStorageBuffer:
+					address = { .address = _device->_device.getBufferAddress( { .buffer = write.pBufferInfo[ i ].buffer } )
+									+ write.pBufferInfo[ i ].offset,
+								.range = write.pBufferInfo[ i ].range };
+					info.data.pStorageBuffer = &address;
+					size = properties.storageBufferDescriptorSize;
+					break;
+				default:
+					assert( false );
+					break;
+			}
+			const auto offset = _binding_offsets[ set_index ][ write.dstBinding ] + ( write.dstArrayElement + i ) * size;
+			_device->_device.getDescriptorEXT( info, size, mapped + offset );
+
+			const auto frame_offset = _set_offsets[ set_index ] + offset;
+			if ( !written.empty() && written.back().offset + written.back().size == frame_offset )
+			{
+				written.back().size += size;
+			}
+			else
+			{
+				written.push_back( { .offset = frame_offset, .size = size } );
+			}
+		}
+	}
+	for ( uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; ++frame )
+	{
+		if ( frame != _frame_index )
+		{
+			_stale_descriptors[ frame ].insert( end( _stale_descriptors[ frame ] ), begin( written ), end( written ) );
+		}
 	}
-	device._device.updateDescriptorSets( writes, {} );
+}
+
+void renderer::BindlessManagerBase::refresh_descriptors()
+{
+	// The previous frame's copy is always up to date, it was refreshed when that frame began then written
+	const auto previous = ( _frame_index + MAX_FRAMES_IN_FLIGHT - 1 ) % MAX_FRAMES_IN_FLIGHT;
+	const auto mapped = static_cast<std::byte*>( _descriptor_buffer.get_mapped_address() );
+	auto& stale = _stale_descriptors[ _frame_index ];
+	for ( const auto& range : stale )
+	{
+		memcpy( mapped + _frame_index * _descriptor_frame_size + range.offset,
+				mapped + previous * _descriptor_frame_size + range.offset,
+				range.size );
+	}
+	stale.clear();
 }
 
 renderer::BindlessTexture renderer::BindlessManagerBase::add_texture( raii::Texture&& tex, bool individual_mips )
 {
-	assert( !individual_mips || tex.get_mips() > 1 );
+	return std::move( add_textures( std::span( &tex, 1 ), individual_mips ).front() );
+}
 
-	const auto aspect = tex.get_format() == Texture::Format::D32_SFLOAT ? TextureView::Aspect::DEPTH : TextureView::Aspect::COLOR;
-	auto view = _device->create_texture_view( tex, aspect );
+std::vector<renderer::BindlessTexture>
+renderer::BindlessManagerBase::add_textures( std::span<raii::Texture> textures, bool individual_mips )
+{
+	OPTICK_EVENT();
 
-	std::vector<raii::TextureView> mips;
-	if ( individual_mips )
+	// Views and descriptor writes are prepared without holding the lock
+	std::vector<BindlessTexture> res;
+	std::vector<raii::TextureView> views;
+	res.reserve( textures.size() );
+	uint32_t sampled_count = 0;
+	uint32_t storage_count = 0;
+	for ( const auto& tex : textures )
 	{
-		mips.reserve( tex.get_mips() );
-		for ( int mip = 0; mip < tex.get_mips(); ++mip )
+		assert( !individual_mips || tex.get_mips() > 1 );
+
+		const auto aspect = tex.get_format() == Texture::Format::D32_SFLOAT ? TextureView::Aspect::DEPTH : TextureView::Aspect::COLOR;
+		auto& texture = res.emplace_back( BindlessTexture { .texture = tex } );
+		texture.handles.view = static_cast<TextureView>( views.emplace_back( _device->create_texture_view( tex, aspect ) ) );
+		if ( individual_mips )
 		{
-			mips.push_back( _device->create_texture_view( tex, aspect, mip ) );
+			texture.mips.reserve( tex.get_mips() );
+			for ( int mip = 0; mip < tex.get_mips(); ++mip )
+			{
+				auto& view = views.emplace_back( _device->create_texture_view( tex, aspect, mip ) );
+				texture.mips.emplace_back( static_cast<TextureView>( view ) );
+			}
 		}
-	}
 
-	BindlessTexture res { .texture = tex, .handles { .view = view } };
-	_texture_memory += tex.get_size();
-	_textures.push_back( std::move( tex ) );
-	_texture_views.push_back( std::move( view ) );
-	add_texture_bindings( _textures.back().get_usage(), res.handles );
+		const auto handle_count = static_cast<uint32_t>( 1 + texture.mips.size() );
+		if ( ( tex.get_usage() & Texture::Usage::SAMPLED ) == Texture::Usage::SAMPLED )
+		{
+			sampled_count += handle_count;
+		}
+		if ( ( tex.get_usage() & Texture::Usage::STORAGE ) == Texture::Usage::STORAGE )
+		{
+			storage_count += handle_count;
+		}
+	}
 
-	res.mips.reserve( mips.size() );
+	auto sampled_indices = reserve_texture_indices( _free_texture_indices, _read_only_textures, sampled_count );
+	std::vector<uint32_t> storage_indices;
+	try
+	{
+		storage_indices = reserve_texture_indices( _free_storage_indices, _read_write_textures, storage_count );
+	}
+	catch ( ... )
+	{
+		// Never written, they can be reused right away
+		std::lock_guard lock( _mutex );
+		_free_texture_indices.insert( end( _free_texture_indices ), begin( sampled_indices ), end( sampled_indices ) );
+		throw;
+	}
 
-	for ( auto& mip : mips )
+	// Infos are referenced by the writes, they must not be reallocated
+	std::vector<vk::DescriptorImageInfo> infos;
+	std::vector<vk::WriteDescriptorSet> writes;
+	infos.reserve( sampled_count + storage_count );
+	writes.reserve( sampled_count + storage_count );
+	const auto assign_indices = [ & ]( Texture::Usage usage, BindlessTexture::Handles& handles )
 	{
-		auto& mip_handle = res.mips.emplace_back( static_cast<TextureView>( mip ) );
-		_texture_views.push_back( std::move( mip ) );
-		add_texture_bindings( _textures.back().get_usage(), mip_handle );
+		if ( ( usage & Texture::Usage::SAMPLED ) == Texture::Usage::SAMPLED )
+		{
+			handles.texture_index = sampled_indices.back();
+			sampled_indices.pop_back();
+		}
+		if ( ( usage & Texture::Usage::STORAGE ) == Texture::Usage::STORAGE )
+		{
+			handles.storage_index = storage_indices.back();
+			storage_indices.pop_back();
+		}
+		get_texture_writes( usage, handles, infos, writes );
+	};
+	for ( auto& texture : res )
+	{
+		assign_indices( texture.texture.get_usage(), texture.handles );
+		for ( auto& mip : texture.mips )
+		{
+			assign_indices( texture.texture.get_usage(), mip );
+		}
 	}
 
+	std::lock_guard lock( _mutex );
+	for ( auto& tex : textures )
+	{
+		_texture_memory += tex.get_size();
+		_textures.push_back( std::move( tex ) );
+	}
+	std::ranges::move( views, std::back_inserter( _texture_views ) );
+	write_descriptors( Sets::TEXTURES, writes );
 	return res;
 }
 
-void renderer::BindlessManagerBase::add_texture_bindings( const Texture::Usage usage, BindlessTexture::Handles& handles )
+void renderer::BindlessManagerBase::remove_texture( const BindlessTexture& texture )
+{
+	std::lock_guard lock( _mutex );
+	const auto texture_it = std::ranges::find( _textures, texture.texture.get_image(), &Texture::get_image );
+	assert( texture_it != end( _textures ) );
+	_texture_memory -= texture.texture.get_size();
+
+	// Frames in flight may still sample the texture, its indices are only recycled once they're done (see begin_frame())
+	_device->queue_deletion( std::move( *texture_it ) );
+	*texture_it = std::move( _textures.back() );
+	_textures.pop_back();
+
+	remove_texture_view( texture.handles );
+	for ( const auto& mip : texture.mips )
+	{
+		remove_texture_view( mip );
+	}
+}
+
+void renderer::BindlessManagerBase::remove_texture_view( const BindlessTexture::Handles& handles )
+{
+	const auto view_it = std::ranges::find_if( _texture_views,
+											   [ & ]( const raii::TextureView& view )
+											   { return static_cast<TextureView>( view )._view == handles.view._view; } );
+	assert( view_it != end( _texture_views ) );
+	_device->queue_deletion( std::move( *view_it ) );
+	*view_it = std::move( _texture_views.back() );
+	_texture_views.pop_back();
+
+	auto& pending = _pending_texture_frees[ _frame_index ];
+	if ( handles.texture_index != static_cast<uint32_t>( -1 ) )
+	{
+		pending.texture_indices.push_back( handles.texture_index );
+	}
+	if ( handles.storage_index != static_cast<uint32_t>( -1 ) )
+	{
+		pending.storage_indices.push_back( handles.storage_index );
+	}
+}
+
+std::vector<uint32_t>
+renderer::BindlessManagerBase::reserve_texture_indices( std::vector<uint32_t>& free_indices, std::atomic<uint32_t>& count, uint32_t needed )
+{
+	std::vector<uint32_t> indices;
+	if ( needed == 0 )
+	{
+		return indices;
+	}
+	indices.reserve( needed );
+	{
+		std::lock_guard lock( _mutex );
+		while ( indices.size() < needed && !free_indices.empty() )
+		{
+			indices.push_back( free_indices.back() );
+			free_indices.pop_back();
+		}
+	}
+
+	// Never used indices don't need the lock
+	const auto remaining = needed - static_cast<uint32_t>( indices.size() );
+	if ( remaining > 0 )
+	{
+		const auto first = count.fetch_add( remaining );
+		if ( first + remaining > _max_textures )
+		{
+			count.fetch_sub( remaining );
+			std::lock_guard lock( _mutex );
+			free_indices.insert( end( free_indices ), begin( indices ), end( indices ) );
+			throw Error( "Bindless texture descriptors out of space" );
+		}
+		for ( uint32_t index = first; index < first + remaining; ++index )
+		{
+			indices.push_back( index );
+		}
+	}
+	return indices;
+}
+
+void renderer::BindlessManagerBase::clear_texture_bindings( const PendingTextureFrees& frees )
 {
-	std::array<vk::DescriptorImageInfo, 2> infos;
-	std::array<vk::WriteDescriptorSet, 2> writes;
-	int count = 0;
+	if ( !_device->get_properties().null_descriptor_support )
+	{
+		// Stale descriptors are fine as long as shaders don't use them
+		return;
+	}
+
+	const vk::DescriptorImageInfo sampled_info { .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
+	const vk::DescriptorImageInfo storage_info { .imageLayout = vk::ImageLayout::eGeneral };
+	std::vector<vk::WriteDescriptorSet> writes;
+	writes.reserve( frees.texture_indices.size() + frees.storage_indices.size() );
+	for ( const auto index : frees.texture_indices )
+	{
+		writes.push_back( { .dstSet = _texture_set,
+							.dstBinding = std::to_underlying( TextureBindings::TEXTURES ),
+							.dstArrayElement = index,
+							.descriptorCount = 1,
+							.descriptorType = vk::DescriptorType::eSampledImage,
+							.pImageInfo = &sampled_info } );
+	}
+	for ( const auto index : frees.storage_indices )
+	{
+		writes.push_back( { .dstSet = _texture_set,
+							.dstBinding = std::to_underlying( TextureBindings::IMAGES ),
+							.dstArrayElement = index,
+							.descriptorCount = 1,
+							.descriptorType = vk::DescriptorType::eStorageImage,
+							.pImageInfo = &storage_info } );
+	}
+	write_descriptors( Sets::TEXTURES, writes );
+}
 
+void renderer::BindlessManagerBase::get_texture_writes( const Texture::Usage usage,
+														const BindlessTexture::Handles& handles,
+														std::vector<vk::DescriptorImageInfo>& infos,
+														std::vector<vk::WriteDescriptorSet>& writes ) const
+{
 	if ( ( usage & Texture::Usage::SAMPLED ) == Texture::Usage::SAMPLED )
 	{
-		handles.texture_index = _read_only_textures++;
-		infos[ count ] = { .imageView = handles.view._view, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
-		writes[ count ] = { .dstSet = _sets[ std::to_underlying( Sets::TEXTURES ) ],
+		const auto& info = infos.emplace_back(
+			vk::DescriptorImageInfo { .imageView = handles.view._view, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal } );
+		writes.push_back( { .dstSet = _texture_set,
 							.dstBinding = std::to_underlying( TextureBindings::TEXTURES ),
 							.dstArrayElement = handles.texture_index,
 							.descriptorCount = 1,
 							.descriptorType = vk::DescriptorType::eSampledImage,
-							.pImageInfo = &infos[ count ] };
-		++count;
+							.pImageInfo = &info } );
 	}
 	if ( ( usage & Texture::Usage::STORAGE ) == Texture::Usage::STORAGE )
 	{
-		handles.storage_index = _read_write_textures++;
-		infos[ count ] = { .imageView = handles.view._view, .imageLayout = vk::ImageLayout::eGeneral };
-		writes[ count ] = { .dstSet = _sets[ std::to_underlying( Sets::TEXTURES ) ],
+		const auto& info
+			= infos.emplace_back( vk::DescriptorImageInfo { .imageView = handles.view._view, .imageLayout = vk::ImageLayout::eGeneral } );
+		writes.push_back( { .dstSet = _texture_set,
 							.dstBinding = std::to_underlying( TextureBindings::IMAGES ),
 							.dstArrayElement = handles.storage_index,
 							.descriptorCount = 1,
 							.descriptorType = vk::DescriptorType::eStorageImage,
-							.pImageInfo = &infos[ count ] };
-		++count;
+							.pImageInfo = &info } );
 	}
+}
+
+void renderer::BindlessManagerBase::write_buffer_binding( uint32_t buffer_index, uint32_t frame_index )
+{
+	// Should we limit the buffer range to the actual used size? Would it be worth the cost of doing a descriptor update on each append?
+	const auto& buffer = _buffers[ buffer_index ]._buffer;
+	const vk::DescriptorBufferInfo info { .buffer = buffer._buffer, .range = buffer.get_size() };
+	const vk::WriteDescriptorSet write { .dstSet = _buffer_sets[ frame_index ],
+										 .dstBinding = buffer_index,
+										 .descriptorCount = 1,
+										 .descriptorType = vk::DescriptorType::eStorageBuffer,
+										 .pBufferInfo = &info };
+	write_descriptors( Sets::BUFFERS, std::span( &write, 1 ) );
+}
 
-	_device->_device.updateDescriptorSets( std::span( writes.data(), count ), {} );
+void renderer::BindlessManagerBase::switch_buffer_binding( uint32_t buffer_index )
+{
+	// The set of the current frame isn't in flight, the others may be
+	write_buffer_binding( buffer_index, _frame_index );
+	if ( _backend == Backend::DESCRIPTOR_BUFFER )
+	{
+		// Already versioned per frame (see write_descriptors())
+		return;
+	}
+	for ( uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; ++frame )
+	{
+		if ( frame != _frame_index )
+		{
+			_stale_buffer_bindings[ frame ].push_back( buffer_index );
+		}
+	}
+}
+
+void renderer::BindlessManagerBase::begin_frame()
+{
+	{
+		// Threads adding textures may be writing descriptors
+		std::lock_guard lock( _descriptor_buffer_mutex );
+		_frame_index = ( _frame_index + 1 ) % MAX_FRAMES_IN_FLIGHT;
+		if ( _backend == Backend::DESCRIPTOR_BUFFER )
+		{
+			refresh_descriptors();
+		}
+	}
+	_staging_offset = 0;
+	for ( auto& buffer : _buffers )
+	{
+		buffer.recycle( _frame_index );
+		buffer.refresh( _frame_index );
+	}
+	auto& stale_bindings = _stale_buffer_bindings[ _frame_index ];
+	for ( const auto buffer_index : stale_bindings )
+	{
+		write_buffer_binding( buffer_index, _frame_index );
+	}
+	stale_bindings.clear();
+
+	std::lock_guard lock( _mutex );
+	auto& pending = _pending_texture_frees[ _frame_index ];
+	clear_texture_bindings( pending );
+	_free_texture_indices.insert( end( _free_texture_indices ), begin( pending.texture_indices ), end( pending.texture_indices ) );
+	_free_storage_indices.insert( end( _free_storage_indices ), begin( pending.storage_indices ), end( pending.storage_indices ) );
+	pending.texture_indices.clear();
+	pending.storage_indices.clear();
+}
+
+uint32_t renderer::BindlessManagerBase::add_buffer_entry( uint32_t buffer_index, const void* data, uint32_t size, bool versioned )
+{
+	auto& buffer = _buffers[ buffer_index ];
+	assert( size == buffer._item_size );
+	bool grown;
+	const uint32_t count = versioned ? MAX_FRAMES_IN_FLIGHT : 1;
+	const auto offset = buffer.allocate( *_device, count, grown );
+	for ( uint32_t version = 0; version < count; ++version )
+	{
+		buffer.write( offset + version * size, data );
+	}
+	if ( grown )
+	{
+		// Device local buffers are only filled by the next flush()
+		if ( buffer.is_mapped() )
+		{
+			switch_buffer_binding( buffer_index );
+		}
+		else
+		{
+			buffer._binding_outdated = true;
+		}
+	}
+	return offset;
+}
+
+void renderer::BindlessManagerBase::update_buffer_entry( uint32_t buffer_index, uint32_t offset, const void* data, uint32_t size )
+{
+	assert( size == _buffers[ buffer_index ]._item_size );
+	_buffers[ buffer_index ].update( offset, _frame_index, data );
+}
+
+void renderer::BindlessManagerBase::flush( CommandBuffer& cmd )
+{
+	OPTICK_EVENT();
+	std::size_t staging_size = 0;
+	for ( auto& buffer : _buffers )
+	{
+		// Sorted so that contiguous entries are merged into a single copy region
+		std::ranges::sort( buffer._dirty_offsets );
+		const auto duplicates = std::ranges::unique( buffer._dirty_offsets );
+		buffer._dirty_offsets.erase( begin( duplicates ), end( duplicates ) );
+		staging_size += buffer._dirty_offsets.size() * buffer._item_size;
+	}
+	if ( staging_size == 0 )
+	{
+		return;
+	}
+
+	// The staging buffer of this frame index was last used MAX_FRAMES_IN_FLIGHT frames ago. Earlier flushes of the
+	// frame are before _staging_offset, a new buffer is needed if they leave too little room.
+	auto& staging = _staging[ _frame_index ];
+	if ( staging.get_size() < _staging_offset + staging_size )
+	{
+		if ( staging.get_size() > 0 )
+		{
+			_device->queue_deletion( std::move( staging ) );
+		}
+		staging = _device->create_buffer( Buffer::Usage::TRANSFER_SRC, std::bit_ceil( _staging_offset + staging_size ), true );
+		_staging_offset = 0;
+	}
+
+	// Every stage the buffers are bound to, task and mesh ones only exist with the extension
+	auto shader_read = get_access_info( Access::ANY_SHADER_READ );
+	if ( _device->get_properties().mesh_shader_support )
+	{
+		shader_read.stages |= get_access_info( Access::TASK_MESH_SHADER_READ ).stages;
+	}
+	const auto transfer_write = get_access_info( Access::TRANSFER_WRITE );
+
+	auto mapped = static_cast<std::byte*>( staging.get_mapped_address() );
+	std::size_t staging_offset = _staging_offset;
+	std::vector<BufferCopy> regions;
+	for ( uint32_t buffer_index = 0; buffer_index < _buffers.size(); ++buffer_index )
+	{
+		auto& buffer = _buffers[ buffer_index ];
+		if ( buffer._dirty_offsets.empty() )
+		{
+			continue;
+		}
+
+		regions.clear();
+		for ( const auto offset : buffer._dirty_offsets )
+		{
+			if ( regions.empty() || regions.back().dst_offset + regions.back().size != offset )
+			{
+				regions.push_back( BufferCopy { .src_offset = staging_offset, .dst_offset = offset } );
+			}
+			regions.back().size += buffer._item_size;
+			staging_offset += buffer._item_size;
+		}
+		for ( const auto& region : regions )
+		{
+			memcpy( mapped + region.src_offset, buffer._shadow.data() + region.dst_offset, region.size );
+		}
+		buffer._dirty_offsets.clear();
+
+		cmd.barrier( buffer._buffer, shader_read, transfer_write );
+		cmd.copy_buffer( staging, buffer._buffer, regions );
+		cmd.barrier( buffer._buffer, transfer_write, shader_read );
+		if ( buffer._binding_outdated )
+		{
+			switch_buffer_binding( buffer_index );
+			buffer._binding_outdated = false;
+		}
+	}
+	_staging_offset = staging_offset;
 }
 
-uint32_t renderer::BindlessManagerBase::add_buffer_entry( uint32_t buffer_index, const void* data, uint32_t size )
+void renderer::BindlessManagerBase::remove_buffer_entry( uint32_t buffer_index, uint32_t offset, bool versioned )
 {
-	return _buffers[ buffer_index ].append( data, size );
+	_buffers[ buffer_index ].remove( offset, _frame_index, versioned );
 }
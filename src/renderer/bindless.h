@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include <renderer/buffer.h>
 #include <renderer/common.h>
 #include <renderer/sampler.h>
@@ -34,21 +36,51 @@ namespace renderer
 		uint32_t index;
 	};
 
+	// Entry with one version per frame in flight, shaders read index + BindlessManagerBase::get_frame_index()
+	template <typename T>
+	struct BindlessVersionedHandle
+	{
+		uint32_t index;
+	};
+
+	class CommandBuffer;
 	class Device;
 
 	// Internal base class with no type safety for buffer, prefer BindlessManager
 	class BindlessManagerBase
 	{
-		// A basic monotonic buffer with max capacity
-		// Could be enhanced with vector-style geometric growth and/or free list delete support if needed
-		// (assuming all contained elements have the same size)
+		// Buffer of same size entries that grows geometrically when full. Removed entries are recycled once the frames
+		// that may still read them are done (see begin_frame()).
+		// Small buffers live in memory mapped device memory (BAR) and are written directly. Bigger ones, or all of them on
+		// devices without BAR, are device local and written through a CPU shadow copy, flushed once per frame (see flush()).
 		struct BindlessBuffer
 		{
-			BindlessBuffer( Device& device, uint32_t capacity );
-			uint32_t append( const void* data, uint32_t size );
+			BindlessBuffer( Device& device, uint32_t item_size, uint32_t capacity );
+			// Returns the offset of count consecutive entries (1 or MAX_FRAMES_IN_FLIGHT), grown is set if the buffer
+			// had to be reallocated
+			uint32_t allocate( Device& device, uint32_t count, bool& grown );
+			void write( uint32_t offset, const void* data );
+			// Writes the version of a versioned entry for that frame, the others are refreshed by later frames
+			void update( uint32_t offset, uint32_t frame_index, const void* data );
+			void refresh( uint32_t frame_index );
+			void remove( uint32_t offset, uint32_t frame_index, bool versioned );
+			void recycle( uint32_t frame_index );
+			bool is_mapped() const { return _buffer._mapped_address != nullptr; }
 
 			raii::Buffer _buffer;
+			uint32_t _item_size = 0;
 			uint32_t _size = 0;
+			std::vector<std::byte> _shadow;
+			// Offsets of entries written since the last flush, device local buffers only
+			std::vector<uint32_t> _dirty_offsets;
+			// Grown device local buffer, shaders keep reading the previous one until flush() has recorded the copy
+			bool _binding_outdated = false;
+			std::vector<uint32_t> _free_offsets;
+			std::vector<uint32_t> _free_versioned_offsets;
+			std::array<std::vector<uint32_t>, MAX_FRAMES_IN_FLIGHT> _pending_frees;
+			std::array<std::vector<uint32_t>, MAX_FRAMES_IN_FLIGHT> _pending_versioned_frees;
+			// Versioned entries updated since that frame's version was last written
+			std::array<std::vector<uint32_t>, MAX_FRAMES_IN_FLIGHT> _stale_versions;
 		};
 
 	public:
@@ -68,12 +100,29 @@ namespace renderer
 			COUNT
 		};
 
+		// Descriptor sets are updated by the driver. Descriptor buffers (VK_EXT_descriptor_buffer) have descriptors written
+		// straight to mapped memory, which is much cheaper when adding many textures. Both use the same shader layout.
+		enum class Backend
+		{
+			DESCRIPTOR_SETS,
+			DESCRIPTOR_BUFFER
+		};
+
+		// Default size of the texture and storage image arrays
 		static constexpr uint32_t MAX_TEXTURES = 8192;
 		static constexpr uint32_t MAX_SAMPLERS = 8;
 
+		struct Desc
+		{
+			Backend backend = Backend::DESCRIPTOR_SETS;
+			// Clamped to Device::Properties::max_bindless_textures
+			uint32_t max_textures = MAX_TEXTURES;
+		};
+
 		// TODO: allow for user supplied samplers to be added
 		static constexpr BindlessSampler LINEAR_SAMPLER { 0 };
 		static constexpr BindlessSampler LINEAR_MIN_SAMPLER { 1 };	// If supported by device
+		static constexpr BindlessSampler LINEAR_MAX_SAMPLER { 2 };	// If supported by device
 
 		std::array<vk::DescriptorSetLayout, SETS_COUNT> get_layouts() const
 		{
@@ -81,37 +130,122 @@ namespace renderer
 			std::copy( begin( _layouts ), end( _layouts ), begin( layouts ) );
 			return layouts;
 		}
-		std::array<vk::DescriptorSet, SETS_COUNT> get_sets() const
+		// Sets to bind for the current frame, each frame in flight has its own buffers set (see begin_frame())
+		std::array<vk::DescriptorSet, SETS_COUNT> get_sets() const { return { *_texture_set, *_buffer_sets[ _frame_index ] }; }
+
+		// Call at the start of each frame, once the frame that used the same index is complete.
+		// Recycles entries and texture indices removed MAX_FRAMES_IN_FLIGHT frames ago, and points this frame's buffer
+		// bindings to buffers that grew since it last ran.
+		void begin_frame();
+		// Version of versioned buffer entries written this frame, give it to shaders (eg: push constants)
+		uint32_t get_frame_index() const { return _frame_index; }
+
+		bool uses_descriptor_buffer() const { return _backend == Backend::DESCRIPTOR_BUFFER; }
+		// Descriptor buffer backend only, both sets are in the same buffer which has a copy per frame in flight
+		vk::DeviceAddress get_descriptor_buffer_address() const { return _descriptor_buffer.get_device_address(); }
+		// In the current frame's copy
+		std::array<vk::DeviceSize, SETS_COUNT> get_set_offsets() const
 		{
+			auto offsets = _set_offsets;
+			for ( auto& offset : offsets )
 			{
-				std::array<vk::DescriptorSet, SETS_COUNT> sets;
-				std::copy( begin( _sets ), end( _sets ), begin( sets ) );
-				return sets;
+				offset += _frame_index * _descriptor_frame_size;
 			}
+			return offsets;
 		}
+		// Records copies of buffer entries added since the last call to their device local buffers. Call after adding
+		// entries and before any shader reads them, outside of rendering. Can be called several times per frame.
+		void flush( CommandBuffer& cmd );
 
+		// Adding textures is thread safe, other methods must be called from a single thread (which may run concurrently
+		// with threads adding textures).
 		BindlessTexture add_texture( raii::Texture&& tex, bool individual_mips = false );
+		// Takes ownership of all textures and writes all their descriptors in a single update
+		std::vector<BindlessTexture> add_textures( std::span<raii::Texture> textures, bool individual_mips = false );
+		// Destroys the texture (and its mip views) once frames that may use it are done, its indices are then reused.
+		// If the device supports null descriptors, recycled slots are cleared until reused.
+		void remove_texture( const BindlessTexture& texture );
 		std::size_t get_texture_memory_usage() const { return _texture_memory; }
 
 	protected:
-		BindlessManagerBase( Device& device, std::span<const uint32_t> buffer_capacities );
+		// Capacities are in entries, buffers grow past them if needed
+		// When the device supports it (see Device::Properties::update_after_bind_support), descriptors are updated after
+		// bind so adding textures doesn't wait for frames in flight, and slots that were never written are fine as long as
+		// shaders don't use them (partially bound).
+		BindlessManagerBase( Device& device,
+							 std::span<const uint32_t> item_sizes,
+							 std::span<const uint32_t> capacities,
+							 const Desc& desc );
 
-		uint32_t add_buffer_entry( uint32_t buffer_index, const void* data, uint32_t size );
+		// Entries are added while recording the current frame, growth switches its buffer binding
+		uint32_t add_buffer_entry( uint32_t buffer_index, const void* data, uint32_t size, bool versioned );
+		void update_buffer_entry( uint32_t buffer_index, uint32_t offset, const void* data, uint32_t size );
+		void remove_buffer_entry( uint32_t buffer_index, uint32_t offset, bool versioned );
 
 	private:
-		void add_texture_bindings( const Texture::Usage usage, BindlessTexture::Handles& handles );
+		struct PendingTextureFrees
+		{
+			std::vector<uint32_t> texture_indices;
+			std::vector<uint32_t> storage_indices;
+		};
+
+		struct DescriptorRange
+		{
+			vk::DeviceSize offset; // In a frame's copy of the descriptor buffer
+			std::size_t size;
+		};
+
+		void create_descriptor_sets();
+		void create_descriptor_buffer();
+		// Updates descriptor sets or writes descriptors to the current frame's copy of the descriptor buffer
+		void write_descriptors( Sets set, std::span<const vk::WriteDescriptorSet> writes );
+		// Copies descriptors written since the current frame last ran to its copy of the descriptor buffer
+		void refresh_descriptors();
+		// Recycled indices first, throws if there are not enough left
+		std::vector<uint32_t> reserve_texture_indices( std::vector<uint32_t>& free_indices, std::atomic<uint32_t>& count, uint32_t needed );
+		void get_texture_writes( const Texture::Usage usage,
+								 const BindlessTexture::Handles& handles,
+								 std::vector<vk::DescriptorImageInfo>& infos,
+								 std::vector<vk::WriteDescriptorSet>& writes ) const;
+		void remove_texture_view( const BindlessTexture::Handles& handles );
+		void clear_texture_bindings( const PendingTextureFrees& frees );
+		void write_buffer_binding( uint32_t buffer_index, uint32_t frame_index );
+		// Points the current frame's binding to the buffer, other frames switch when they begin
+		void switch_buffer_binding( uint32_t buffer_index );
 
 		Device* _device;
+		Backend _backend;
+		uint32_t _max_textures;
+		bool _update_after_bind = false;
 		std::array<vk::raii::DescriptorSetLayout, std::to_underlying( Sets::COUNT )> _layouts = { { nullptr, nullptr } };
 		vk::raii::DescriptorPool _pool = nullptr;
-		std::array<vk::raii::DescriptorSet, std::to_underlying( Sets::COUNT )> _sets = { { nullptr, nullptr } };
+		vk::raii::DescriptorSet _texture_set = nullptr;
+		// Frames in flight keep reading the buffers they were recorded with while the current frame's binding changes
+		std::array<vk::raii::DescriptorSet, MAX_FRAMES_IN_FLIGHT> _buffer_sets = { { nullptr, nullptr } };
+		std::array<std::vector<uint32_t>, MAX_FRAMES_IN_FLIGHT> _stale_buffer_bindings;
+		raii::Buffer _descriptor_buffer;
+		vk::DeviceSize _descriptor_frame_size = 0;
+		// Guards the frame index seen by threads writing to the descriptor buffer, and the ranges they write
+		std::mutex _descriptor_buffer_mutex;
+		std::array<std::vector<DescriptorRange>, MAX_FRAMES_IN_FLIGHT> _stale_descriptors;
+		std::array<vk::DeviceSize, SETS_COUNT> _set_offsets = {};
+		std::array<std::vector<vk::DeviceSize>, SETS_COUNT> _binding_offsets;
 		std::vector<raii::Texture> _textures;
 		std::vector<raii::TextureView> _texture_views;
-		uint32_t _read_only_textures = 0;
-		uint32_t _read_write_textures = 0;
+		// Guards texture storage, free lists and descriptor updates of the textures set
+		std::mutex _mutex;
+		std::atomic<uint32_t> _read_only_textures = 0;
+		std::atomic<uint32_t> _read_write_textures = 0;
+		std::vector<uint32_t> _free_texture_indices;
+		std::vector<uint32_t> _free_storage_indices;
+		std::array<PendingTextureFrees, MAX_FRAMES_IN_FLIGHT> _pending_texture_frees;
 		std::size_t _texture_memory = 0;
 		std::vector<raii::Sampler> _samplers;
 		std::vector<BindlessBuffer> _buffers;
+		std::array<raii::Buffer, MAX_FRAMES_IN_FLIGHT> _staging;
+		// Used by flushes of the current frame
+		std::size_t _staging_offset = 0;
+		uint32_t _frame_index = 0;
 	};
 
 	// Bindless manager for pipelines
@@ -120,10 +254,13 @@ namespace renderer
 	// - set 0, binding 1: storage image array
 	// - set 0, binding 2: sampler array
 	// - set 0, binding 3-N: reserved for now
+	// Array, cube and 3D textures share the texture and storage image bindings, declare the same binding once per
+	// dimension in shaders (eg: texture2D textures[], textureCube cubes[] and texture2DArray arrays[] all on binding 0).
 	// - set 1, binding 0: storage buffer for type #1
 	// - set 1, binding 1: storage buffer for type #2
 	// ...
 	// - set 1, binding N-1: storage buffer for type #N
+	// Versioned entries are read at handle index + frame index (see BindlessManagerBase::get_frame_index()).
 	template <typename... BufferTypes>
 	class BindlessManager : public BindlessManagerBase
 	{
@@ -146,27 +283,56 @@ namespace renderer
 			static constexpr std::size_t value = 1 + buffer_index<T, std::tuple<Types...>>::value;
 		};
 
-		static constexpr std::array<uint32_t, buffer_count> calc_capacities( std::span<const uint32_t, buffer_count> caps )
+	public:
+		// Initial capacities, in entries of each type
+		BindlessManager( Device& device, std::span<const uint32_t, buffer_count> capacities, const Desc& desc = {} )
+			: BindlessManagerBase( device, buffer_item_size, capacities, desc )
 		{
-			auto capacities = buffer_item_size;
-			for ( int i = 0; i < buffer_count; ++i )
-			{
-				capacities[ i ] *= caps[ i ];
-			}
-			return capacities;
 		}
 
-	public:
-		BindlessManager( Device& device, std::span<const uint32_t, buffer_count> capacities )
-			: BindlessManagerBase( device, calc_capacities( capacities ) )
+		// Binding of the storage buffer of T in set 1, for modules declaring it in their own shaders
+		template <typename T>
+		static constexpr uint32_t get_buffer_binding()
 		{
+			return buffer_index<T, buffers_tuple>::value;
 		}
 
 		template <typename T>
 		BindlessHandle<T> add_buffer_entry( const T& value )
 		{
-			const auto offset = BindlessManagerBase::add_buffer_entry( buffer_index<T, buffers_tuple>::value, &value, sizeof( T ) );
+			const auto offset = BindlessManagerBase::add_buffer_entry( buffer_index<T, buffers_tuple>::value, &value, sizeof( T ), false );
+			return { offset / static_cast<uint32_t>( sizeof( T ) ) };
+		}
+
+		// For data that changes every frame, see BindlessVersionedHandle
+		template <typename T>
+		BindlessVersionedHandle<T> add_versioned_buffer_entry( const T& value )
+		{
+			const auto offset = BindlessManagerBase::add_buffer_entry( buffer_index<T, buffers_tuple>::value, &value, sizeof( T ), true );
 			return { offset / static_cast<uint32_t>( sizeof( T ) ) };
 		}
+
+		// Only writes the current frame's version, frames in flight keep reading theirs
+		template <typename T>
+		void update_buffer_entry( BindlessVersionedHandle<T> handle, const T& value )
+		{
+			const auto offset = handle.index * static_cast<uint32_t>( sizeof( T ) );
+			BindlessManagerBase::update_buffer_entry( buffer_index<T, buffers_tuple>::value, offset, &value, sizeof( T ) );
+		}
+
+		// The handle may be given to a new entry once frames in flight are done (see begin_frame())
+		template <typename T>
+		void remove_buffer_entry( BindlessHandle<T> handle )
+		{
+			const auto offset = handle.index * static_cast<uint32_t>( sizeof( T ) );
+			BindlessManagerBase::remove_buffer_entry( buffer_index<T, buffers_tuple>::value, offset, false );
+		}
+
+		template <typename T>
+		void remove_buffer_entry( BindlessVersionedHandle<T> handle )
+		{
+			const auto offset = handle.index * static_cast<uint32_t>( sizeof( T ) );
+			BindlessManagerBase::remove_buffer_entry( buffer_index<T, buffers_tuple>::value, offset, true );
+		}
 	};
 }
@@ -19,6 +19,15 @@ void renderer::raii::Buffer::unmap()
 	_mapped_address = nullptr;
 }
 
+void renderer::raii::Buffer::invalidate()
+{
+	const auto ret = vmaInvalidateAllocation( _allocation.allocator, _allocation.allocation, 0, VK_WHOLE_SIZE );
+	if ( ret )
+	{
+		throw Error( "Failed to invalidate buffer", ret );
+	}
+}
+
 vk::DeviceAddress renderer::Buffer::get_device_address() const
 {
 	assert( ( _usage & Usage::SHADER_DEVICE_ADDRESS ) == Usage::SHADER_DEVICE_ADDRESS );
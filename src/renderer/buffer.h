@@ -20,8 +20,22 @@ namespace renderer
 			INDEX_BUFFER = std::to_underlying( vk::BufferUsageFlagBits::eIndexBuffer ),
 			INDIRECT_BUFFER = std::to_underlying( vk::BufferUsageFlagBits::eIndirectBuffer ),
 			SHADER_DEVICE_ADDRESS = std::to_underlying( vk::BufferUsageFlagBits::eShaderDeviceAddress ),
+			RESOURCE_DESCRIPTOR_BUFFER = std::to_underlying( vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT ),
+			SAMPLER_DESCRIPTOR_BUFFER = std::to_underlying( vk::BufferUsageFlagBits::eSamplerDescriptorBufferEXT ),
 		};
 
+		enum class IndexType : std::underlying_type_t<vk::IndexType>
+		{
+			UINT8 = std::to_underlying( vk::IndexType::eUint8EXT ), // See Device::Properties::index_type_uint8_support
+			UINT16 = std::to_underlying( vk::IndexType::eUint16 ),
+			UINT32 = std::to_underlying( vk::IndexType::eUint32 )
+		};
+
+		static constexpr std::size_t get_index_size( IndexType type )
+		{
+			return type == IndexType::UINT8 ? 1 : type == IndexType::UINT16 ? 2 : 4;
+		}
+
 		Buffer() = default;
 		vk::DeviceAddress get_device_address() const;
 		void* get_mapped_address() const;
@@ -54,6 +68,7 @@ namespace renderer
 		friend class BindlessManagerBase;
 		friend class CommandBuffer;
 		friend class Device;
+		friend class UploadManager;
 	};
 
 	inline constexpr Buffer::Usage operator|( Buffer::Usage lhs, Buffer::Usage rhs )
@@ -92,6 +107,8 @@ namespace renderer
 
 			void map();
 			void unmap();
+			// Makes GPU writes visible to reads through the mapped address, no-op on host coherent memory
+			void invalidate();
 
 		private:
 			Buffer( const renderer::Buffer& Desc, const vma::raii::Allocation& allocation )
@@ -1,6 +1,8 @@
 #include "command_buffer.h"
 
+#include <algorithm>
 #include <cassert>
+#include <ranges>
 #include <renderer/bindless.h>
 #include <renderer/buffer.h>
 #include <renderer/details/profiler.h>
@@ -10,6 +12,8 @@
 void renderer::CommandBuffer::begin()
 {
 	_cmd_buffer.begin( vk::CommandBufferBeginInfo { .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit } );
+	invalidate_state();
+	_elided = { };
 #ifdef USE_OPTICK
 	_optick_previous = Optick::SetGpuContext( Optick::GPUContext( static_cast<VkCommandBuffer>( *_cmd_buffer ) ) ).cmdBuffer;
 #endif
@@ -17,6 +21,7 @@ void renderer::CommandBuffer::begin()
 
 void renderer::CommandBuffer::end()
 {
+	flush_barriers();
 	_cmd_buffer.end();
 #ifdef USE_OPTICK
 	Optick::SetGpuContext( Optick::GPUContext( _optick_previous ) );
@@ -29,6 +34,11 @@ void renderer::CommandBuffer::reset()
 	_cmd_buffer.reset();
 }
 
+void renderer::CommandBuffer::invalidate_state()
+{
+	_bound = { };
+}
+
 void renderer::CommandBuffer::texture_barrier( const Texture& tex,
 											   Texture::Layout src_layout,
 											   Texture::Layout dst_layout,
@@ -36,27 +46,136 @@ void renderer::CommandBuffer::texture_barrier( const Texture& tex,
 											   vk::PipelineStageFlags2 dst_stage,
 											   vk::AccessFlags2 src_access,
 											   vk::AccessFlags2 dst_access,
-											   int mip_level )
+											   TextureSubresource range )
 {
-	assert( mip_level == -1 || mip_level < tex.get_mips() );
+	assert( range.base_mip < tex.get_mips() );
+	assert( range.mip_count == -1 || range.base_mip + range.mip_count <= tex.get_mips() );
+
+	// Barriers in the same batch aren't ordered, a second transition of the same subresource has to go in the next one
+	const auto mip_end = [ & ]( uint32_t base, uint32_t count )
+	{ return count == VK_REMAINING_MIP_LEVELS ? static_cast<uint32_t>( tex.get_mips() ) : base + count; };
+	const uint32_t first_mip = range.base_mip;
+	const uint32_t last_mip = mip_end( range.base_mip, range.mip_count == -1 ? VK_REMAINING_MIP_LEVELS : range.mip_count );
+	if ( std::ranges::any_of( _image_barriers,
+							  [ & ]( const auto& pending )
+							  {
+								  const auto& pending_range = pending.subresourceRange;
+								  return pending.image == tex._image && pending_range.baseMipLevel < last_mip
+									  && first_mip < mip_end( pending_range.baseMipLevel, pending_range.levelCount );
+							  } ) )
+	{
+		flush_barriers();
+	}
 
 	const vk::ImageAspectFlags aspectMask = ( tex.get_format() == Texture::Format::D32_SFLOAT ) ? vk::ImageAspectFlagBits::eDepth
 																								: vk::ImageAspectFlagBits::eColor;
-	const vk::ImageMemoryBarrier2 imageBarrier { .srcStageMask = src_stage,
-												 .srcAccessMask = src_access,
-												 .dstStageMask = dst_stage,
-												 .dstAccessMask = dst_access,
-												 .oldLayout = static_cast<vk::ImageLayout>( src_layout ),
-												 .newLayout = static_cast<vk::ImageLayout>( dst_layout ),
-												 .image = tex._image,
-												 .subresourceRange = {
-													 .aspectMask = aspectMask,
-													 .baseMipLevel = static_cast<uint32_t>( mip_level == -1 ? 0 : mip_level ),
-													 .levelCount = mip_level == -1 ? VK_REMAINING_MIP_LEVELS : 1,
-													 .layerCount = VK_REMAINING_ARRAY_LAYERS,
-												 } };
-
-	_cmd_buffer.pipelineBarrier2( vk::DependencyInfo { .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &imageBarrier } );
+	_image_barriers.push_back( { .srcStageMask = src_stage,
+								 .srcAccessMask = src_access,
+								 .dstStageMask = dst_stage,
+								 .dstAccessMask = dst_access,
+								 .oldLayout = static_cast<vk::ImageLayout>( src_layout ),
+								 .newLayout = static_cast<vk::ImageLayout>( dst_layout ),
+								 .image = tex._image,
+								 .subresourceRange = {
+									 .aspectMask = aspectMask,
+									 .baseMipLevel = static_cast<uint32_t>( range.base_mip ),
+									 .levelCount = range.mip_count == -1 ? VK_REMAINING_MIP_LEVELS : static_cast<uint32_t>( range.mip_count ),
+									 .baseArrayLayer = static_cast<uint32_t>( range.base_layer ),
+									 .layerCount = range.layer_count == -1 ? VK_REMAINING_ARRAY_LAYERS
+																		   : static_cast<uint32_t>( range.layer_count ),
+								 } } );
+}
+
+void renderer::CommandBuffer::barrier( const Texture& tex, Access src, Access dst, TextureSubresource range )
+{
+	const auto src_info = get_access_info( src );
+	const auto dst_info = get_access_info( dst );
+	// Read after read needs no memory dependency, only an execution one
+	texture_barrier( tex,
+					 src_info.layout,
+					 dst_info.layout,
+					 src_info.stages,
+					 dst_info.stages,
+					 src_info.is_write() ? src_info.access : vk::AccessFlags2 { },
+					 dst_info.access,
+					 range );
+}
+
+void renderer::CommandBuffer::barrier( const Buffer& buffer, Access src, Access dst, std::size_t offset, std::size_t size )
+{
+	barrier( buffer, get_access_info( src ), get_access_info( dst ), offset, size );
+}
+
+void renderer::CommandBuffer::barrier(
+	const Buffer& buffer, const AccessInfo& src_info, const AccessInfo& dst_info, std::size_t offset, std::size_t size )
+{
+	buffer_barrier( buffer,
+					src_info.stages,
+					dst_info.stages,
+					src_info.is_write() ? src_info.access : vk::AccessFlags2 { },
+					dst_info.access,
+					offset,
+					size );
+}
+
+void renderer::CommandBuffer::use_texture( const Texture& tex, Access access, TextureSubresource range )
+{
+	assert( tex._state );
+	assert( range.base_mip < tex.get_mips() );
+	const auto next = get_access_info( access );
+	auto& mips = tex._state->mips;
+	const int end_mip = range.mip_count == -1 ? tex.get_mips() : range.base_mip + range.mip_count;
+
+	// Group consecutive mips in the same state into a single barrier
+	int group_start = range.base_mip;
+	for ( int mip = range.base_mip; mip <= end_mip; ++mip )
+	{
+		if ( mip < end_mip && mip > group_start && mips[ mip ] == mips[ group_start ] )
+		{
+			continue;
+		}
+		if ( mip > group_start )
+		{
+			const auto& prev = mips[ group_start ];
+			const TextureSubresource group { .base_mip = group_start, .mip_count = mip - group_start };
+			if ( prev.layout == next.layout && !prev.is_write() && !next.is_write() )
+			{
+				// Read after read, no barrier but later writes will have to wait for both readers
+				for ( int i = group_start; i < mip; ++i )
+				{
+					mips[ i ].stages |= next.stages;
+					mips[ i ].access |= next.access;
+				}
+			}
+			else
+			{
+				texture_barrier( tex,
+								 prev.layout,
+								 next.layout,
+								 prev.stages,
+								 next.stages,
+								 prev.is_write() ? prev.access : vk::AccessFlags2 { },
+								 next.access,
+								 group );
+				std::fill( begin( mips ) + group_start, begin( mips ) + mip, next );
+			}
+		}
+		group_start = mip;
+	}
+}
+
+void renderer::CommandBuffer::flush_barriers()
+{
+	if ( _image_barriers.empty() && _buffer_barriers.empty() )
+	{
+		return;
+	}
+	_cmd_buffer.pipelineBarrier2( vk::DependencyInfo { .bufferMemoryBarrierCount = static_cast<uint32_t>( _buffer_barriers.size() ),
+													   .pBufferMemoryBarriers = _buffer_barriers.data(),
+													   .imageMemoryBarrierCount = static_cast<uint32_t>( _image_barriers.size() ),
+													   .pImageMemoryBarriers = _image_barriers.data() } );
+	_image_barriers.clear();
+	_buffer_barriers.clear();
 }
 
 void renderer::CommandBuffer::transition_texture( const Texture& tex,
@@ -64,7 +183,8 @@ void renderer::CommandBuffer::transition_texture( const Texture& tex,
 												  Texture::Layout dst_layout,
 												  int mip_level )
 {
-	// XXX: _extremely_ conservative barrier
+	assert( mip_level == -1 || mip_level < tex.get_mips() );
+	// XXX: _extremely_ conservative barrier, prefer barrier() with precise accesses
 	texture_barrier( tex,
 					 src_layout,
 					 dst_layout,
@@ -72,16 +192,37 @@ void renderer::CommandBuffer::transition_texture( const Texture& tex,
 					 vk::PipelineStageFlagBits2::eAllCommands,
 					 vk::AccessFlagBits2::eMemoryWrite,
 					 vk::AccessFlagBits2::eMemoryWrite | vk::AccessFlagBits2::eMemoryRead,
-					 mip_level );
+					 TextureSubresource { .base_mip = mip_level == -1 ? 0 : mip_level, .mip_count = mip_level == -1 ? -1 : 1 } );
+
+	if ( tex._state )
+	{
+		// Everything has been made visible by the barrier, treat it as a read so next reads in the same layout are free
+		const AccessInfo state { .stages = vk::PipelineStageFlagBits2::eAllCommands,
+								 .access = vk::AccessFlagBits2::eMemoryRead,
+								 .layout = dst_layout };
+		auto& mips = tex._state->mips;
+		if ( mip_level == -1 )
+		{
+			std::fill( begin( mips ), end( mips ), state );
+		}
+		else
+		{
+			mips[ mip_level ] = state;
+		}
+	}
 }
 
 void renderer::CommandBuffer::blit_texture( const Texture& src, const Texture& dst )
 {
+	use_texture( src, Access::TRANSFER_READ, { .mip_count = 1 } );
+	use_texture( dst, Access::TRANSFER_WRITE, { .mip_count = 1 } );
+	flush_barriers();
+	assert( src._desc.layers == dst._desc.layers );
 	const vk::ImageBlit2 blit_region {
-		.srcSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .layerCount = 1 },
-		.srcOffsets = { { vk::Offset3D { }, vk::Offset3D( src._desc.extent.width, src._desc.extent.height, 1 ) } },
-		.dstSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .layerCount = 1 },
-		.dstOffsets = { { vk::Offset3D { }, vk::Offset3D( dst._desc.extent.width, dst._desc.extent.height, 1 ) } }
+		.srcSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .layerCount = static_cast<uint32_t>( src._desc.layers ) },
+		.srcOffsets = { { vk::Offset3D { }, vk::Offset3D( src._desc.extent.width, src._desc.extent.height, src._desc.depth ) } },
+		.dstSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .layerCount = static_cast<uint32_t>( dst._desc.layers ) },
+		.dstOffsets = { { vk::Offset3D { }, vk::Offset3D( dst._desc.extent.width, dst._desc.extent.height, dst._desc.depth ) } }
 	};
 
 	const vk::BlitImageInfo2 blit_info { .srcImage = src._image,
@@ -94,36 +235,121 @@ void renderer::CommandBuffer::blit_texture( const Texture& src, const Texture& d
 	_cmd_buffer.blitImage2( blit_info );
 }
 
+void renderer::CommandBuffer::generate_mips( const Texture& tex )
+{
+	for ( int mip = 1; mip < tex._desc.mips; ++mip )
+	{
+		use_texture( tex, Access::TRANSFER_READ, { .base_mip = mip - 1, .mip_count = 1 } );
+		use_texture( tex, Access::TRANSFER_WRITE, { .base_mip = mip, .mip_count = 1 } );
+		flush_barriers();
+
+		// All layers at once, 3D textures are halved in depth too
+		const auto src_width = std::max( tex._desc.extent.width >> ( mip - 1 ), 1u );
+		const auto src_height = std::max( tex._desc.extent.height >> ( mip - 1 ), 1u );
+		const auto src_depth = std::max( tex._desc.depth >> ( mip - 1 ), 1 );
+		const auto layers = static_cast<uint32_t>( tex._desc.layers );
+		const vk::ImageBlit2 blit_region {
+			.srcSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = uint32_t( mip - 1 ), .layerCount = layers },
+			.srcOffsets = { { vk::Offset3D { }, vk::Offset3D( src_width, src_height, src_depth ) } },
+			.dstSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = uint32_t( mip ), .layerCount = layers },
+			.dstOffsets = { { vk::Offset3D { },
+							  vk::Offset3D( std::max( src_width / 2, 1u ), std::max( src_height / 2, 1u ), std::max( src_depth / 2, 1 ) ) } }
+		};
+
+		const vk::BlitImageInfo2 blit_info { .srcImage = tex._image,
+											 .srcImageLayout = vk::ImageLayout::eTransferSrcOptimal,
+											 .dstImage = tex._image,
+											 .dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+											 .regionCount = 1,
+											 .pRegions = &blit_region,
+											 .filter = vk::Filter::eLinear };
+
+		_cmd_buffer.blitImage2( blit_info );
+	}
+}
+
 void renderer::CommandBuffer::copy_buffer( const Buffer& src,
 										   std::size_t offset,
 										   std::size_t size,
 										   const Buffer& dest,
 										   std::size_t dest_offset )
 {
+	flush_barriers();
 	_cmd_buffer.copyBuffer( src._buffer, dest._buffer, vk::BufferCopy { .srcOffset = offset, .dstOffset = dest_offset, .size = size } );
 }
 
+void renderer::CommandBuffer::copy_buffer( const Buffer& src, const Buffer& dest, std::span<const BufferCopy> regions )
+{
+	flush_barriers();
+	std::vector<vk::BufferCopy> copies;
+	copies.reserve( regions.size() );
+	for ( const auto& region : regions )
+	{
+		assert( region.src_offset + region.size <= src.get_size() );
+		assert( region.dst_offset + region.size <= dest.get_size() );
+		copies.push_back( vk::BufferCopy { .srcOffset = region.src_offset, .dstOffset = region.dst_offset, .size = region.size } );
+	}
+	_cmd_buffer.copyBuffer( src._buffer, dest._buffer, copies );
+}
+
+void renderer::CommandBuffer::copy_buffer_to_texture( const Buffer& buffer,
+													  const Texture& tex,
+													  std::span<const BufferTextureCopy> regions )
+{
+	if ( regions.empty() )
+	{
+		return;
+	}
+
+	const auto [ min_mip, max_mip ] = std::ranges::minmax( regions | std::views::transform( &BufferTextureCopy::mip ) );
+	use_texture( tex, Access::TRANSFER_WRITE, { .base_mip = min_mip, .mip_count = max_mip - min_mip + 1 } );
+	flush_barriers();
+
+	std::vector<vk::BufferImageCopy> copies;
+	copies.reserve( regions.size() );
+	for ( const auto& region : regions )
+	{
+		assert( region.mip < tex.get_mips() );
+		copies.push_back( vk::BufferImageCopy {
+			.bufferOffset = region.buffer_offset,
+			.imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor,
+								  .mipLevel = static_cast<uint32_t>( region.mip ),
+								  .baseArrayLayer = static_cast<uint32_t>( region.base_layer ),
+								  .layerCount = static_cast<uint32_t>( region.layer_count == -1 ? tex._desc.layers - region.base_layer
+																								: region.layer_count ) },
+			.imageExtent = vk::Extent3D { .width = std::max( tex._desc.extent.width >> region.mip, 1u ),
+										  .height = std::max( tex._desc.extent.height >> region.mip, 1u ),
+										  .depth = static_cast<uint32_t>( std::max( tex._desc.depth >> region.mip, 1 ) ) } } );
+	}
+	_cmd_buffer.copyBufferToImage( buffer._buffer, tex._image, vk::ImageLayout::eTransferDstOptimal, copies );
+}
+
 void renderer::CommandBuffer::copy_buffer_to_texture( const Buffer& buffer, std::size_t offset, const Texture& tex )
 {
+	use_texture( tex, Access::TRANSFER_WRITE, { .mip_count = 1 } );
+	flush_barriers();
 	_cmd_buffer.copyBufferToImage(
 		buffer._buffer,
 		tex._image,
 		vk::ImageLayout::eTransferDstOptimal,
 		vk::BufferImageCopy {
 			.bufferOffset = offset,
-			.imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .layerCount = 1 },
-			.imageExtent = vk::Extent3D { .width = tex._desc.extent.width, .height = tex._desc.extent.height, .depth = 1 } } );
+			.imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .layerCount = static_cast<uint32_t>( tex._desc.layers ) },
+			.imageExtent = vk::Extent3D { .width = tex._desc.extent.width,
+										  .height = tex._desc.extent.height,
+										  .depth = static_cast<uint32_t>( tex._desc.depth ) } } );
 }
 
 void renderer::CommandBuffer::fill_buffer( const Buffer& buffer, size_t offset, size_t size, uint32_t value )
 {
+	flush_barriers();
 	assert( offset + size <= buffer.get_size() );
 	_cmd_buffer.fillBuffer( buffer.get_buffer(), offset, size, value );
 }
 
 void renderer::CommandBuffer::buffer_barrier( const Buffer& buffer )
 {
-	// XXX: aggressive write -> read barrier
+	// XXX: aggressive write -> read barrier, prefer barrier() with precise accesses
 	buffer_barrier( buffer,
 					vk::PipelineStageFlagBits2::eAllCommands,
 					vk::PipelineStageFlagBits2::eAllCommands,
@@ -135,21 +361,33 @@ void renderer::CommandBuffer::buffer_barrier( const Buffer& buffer,
 											  vk::PipelineStageFlags2 src_stage,
 											  vk::PipelineStageFlags2 dst_stage,
 											  vk::AccessFlags2 src_access,
-											  vk::AccessFlags2 dst_access )
+											  vk::AccessFlags2 dst_access,
+											  std::size_t offset,
+											  std::size_t size )
 {
-	const vk::BufferMemoryBarrier2 bufferBarrier { .srcStageMask = src_stage,
-												   .srcAccessMask = src_access,
-												   .dstStageMask = dst_stage,
-												   .dstAccessMask = dst_access,
-												   .buffer = buffer.get_buffer(),
-												   .offset = 0,
-												   .size = buffer.get_size() };
+	assert( offset < buffer.get_size() );
+	assert( size == VK_WHOLE_SIZE || offset + size <= buffer.get_size() );
+
+	if ( std::ranges::any_of( _buffer_barriers, [ & ]( const auto& pending ) { return pending.buffer == buffer.get_buffer(); } ) )
+	{
+		flush_barriers();
+	}
 
-	_cmd_buffer.pipelineBarrier2( vk::DependencyInfo { .bufferMemoryBarrierCount = 1, .pBufferMemoryBarriers = &bufferBarrier } );
+	_buffer_barriers.push_back( { .srcStageMask = src_stage,
+								  .srcAccessMask = src_access,
+								  .dstStageMask = dst_stage,
+								  .dstAccessMask = dst_access,
+								  .buffer = buffer.get_buffer(),
+								  .offset = offset,
+								  .size = size } );
 }
 
-void renderer::CommandBuffer::begin_rendering( Extent2D extent, RenderAttachment color_target, RenderAttachment depth_target )
+void renderer::CommandBuffer::begin_rendering( Extent2D extent,
+												RenderAttachment color_target,
+												RenderAttachment depth_target,
+												uint32_t view_mask )
 {
+	flush_barriers();
 	vk::RenderingAttachmentInfo color_attachment { .imageView = color_target.target._view,
 												   .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
 												   .storeOp = vk::AttachmentStoreOp::eStore };
@@ -195,6 +433,7 @@ void renderer::CommandBuffer::begin_rendering( Extent2D extent, RenderAttachment
 
 	const vk::RenderingInfo renderInfo { .renderArea = vk::Rect2D { .extent = extent },
 										 .layerCount = 1,
+										 .viewMask = view_mask,
 										 .colorAttachmentCount = 1,
 										 .pColorAttachments = &color_attachment,
 										 .pDepthAttachment = depth_target.target._view ? &depth_attachment : nullptr };
@@ -211,22 +450,63 @@ void renderer::CommandBuffer::bind_pipeline( const Pipeline& pipeline, const Bin
 {
 	const auto bind_point = pipeline.get_type() == Pipeline::Type::Compute ? vk::PipelineBindPoint::eCompute
 																		   : vk::PipelineBindPoint::eGraphics;
-	_cmd_buffer.bindPipeline( bind_point, pipeline._pipeline );
+	auto& bound = _bound.pipelines[ std::to_underlying( pipeline.get_type() ) ];
+	if ( bound.pipeline == pipeline._pipeline )
+	{
+		++_elided.pipelines;
+	}
+	else
+	{
+		_cmd_buffer.bindPipeline( bind_point, pipeline._pipeline );
+		bound.pipeline = pipeline._pipeline;
+	}
+
 	const auto sets = bindless_manager.get_sets();
-	for ( int i = 0; i < sets.size(); ++i )
+	if ( bound.layout == pipeline._layout && bound.bindless_manager == &bindless_manager )
 	{
-		_cmd_buffer.bindDescriptorSets( bind_point, pipeline._layout, i, sets[ i ], { } );
+		_elided.descriptor_sets += static_cast<uint32_t>( sets.size() );
+	}
+	else
+	{
+		if ( bindless_manager.uses_descriptor_buffer() )
+		{
+			// Both sets are read from the same descriptor buffer, at different offsets
+			const vk::DescriptorBufferBindingInfoEXT binding { .address = bindless_manager.get_descriptor_buffer_address(),
+															   .usage = vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT
+																   | vk::BufferUsageFlagBits::eSamplerDescriptorBufferEXT };
+			const std::array<uint32_t, BindlessManagerBase::SETS_COUNT> buffer_indices = {};
+			const auto offsets = bindless_manager.get_set_offsets();
+			_cmd_buffer.bindDescriptorBuffersEXT( binding );
+			_cmd_buffer.setDescriptorBufferOffsetsEXT( bind_point, pipeline._layout, 0, buffer_indices, offsets );
+		}
+		else
+		{
+			_cmd_buffer.bindDescriptorSets( bind_point, pipeline._layout, 0, sets, { } );
+		}
+		bound.layout = pipeline._layout;
+		bound.bindless_manager = &bindless_manager;
 	}
 }
 
 void renderer::CommandBuffer::set_scissor( Extent2D extent )
 {
+	if ( _bound.scissor == extent )
+	{
+		++_elided.scissors;
+		return;
+	}
 	const vk::Rect2D scissor { .extent = extent };
 	_cmd_buffer.setScissor( 0, scissor );
+	_bound.scissor = extent;
 }
 
 void renderer::CommandBuffer::set_viewport( Extent2D extent )
 {
+	if ( _bound.viewport == extent )
+	{
+		++_elided.viewports;
+		return;
+	}
 	const vk::Viewport viewport { .x = 0.f,
 								  .y = 0.f,
 								  .width = static_cast<float>( extent.width ),
@@ -235,26 +515,40 @@ void renderer::CommandBuffer::set_viewport( Extent2D extent )
 								  .maxDepth = 1.f };
 
 	_cmd_buffer.setViewport( 0, viewport );
+	_bound.viewport = extent;
 }
 
-void renderer::CommandBuffer::bind_index_buffer( const Buffer& index_buffer )
+void renderer::CommandBuffer::bind_index_buffer( const Buffer& index_buffer, Buffer::IndexType type, std::size_t offset )
 {
 	assert( ( index_buffer._usage & Buffer::Usage::INDEX_BUFFER ) == Buffer::Usage::INDEX_BUFFER );
-	_cmd_buffer.bindIndexBuffer( index_buffer._buffer, 0, vk::IndexType::eUint32 );
+	assert( offset % Buffer::get_index_size( type ) == 0 );
+	const auto index_type = static_cast<vk::IndexType>( type );
+	if ( _bound.index_buffer == index_buffer._buffer && _bound.index_offset == offset && _bound.index_type == index_type )
+	{
+		++_elided.index_buffers;
+		return;
+	}
+	_cmd_buffer.bindIndexBuffer( index_buffer._buffer, offset, index_type );
+	_bound.index_buffer = index_buffer._buffer;
+	_bound.index_offset = offset;
+	_bound.index_type = index_type;
 }
 
 void renderer::CommandBuffer::draw( uint32_t count )
 {
+	flush_barriers();
 	_cmd_buffer.draw( count, 1, 0, 0 );
 }
 
 void renderer::CommandBuffer::draw_indexed( uint32_t count, uint32_t instance_count, uint32_t first_index, uint32_t first_instance )
 {
+	flush_barriers();
 	_cmd_buffer.drawIndexed( count, instance_count, first_index, 0, first_instance );
 }
 
 void renderer::CommandBuffer::draw_indexed_indirect( const Buffer& buffer, size_t offset, uint32_t count, uint32_t stride )
 {
+	flush_barriers();
 	assert( offset < buffer.get_size() );
 	_cmd_buffer.drawIndexedIndirect( buffer.get_buffer(), offset, count, stride );
 }
@@ -266,6 +560,7 @@ void renderer::CommandBuffer::draw_indexed_indirect( const Buffer& buffer,
 													 uint32_t max_draws,
 													 uint32_t stride )
 {
+	flush_barriers();
 	assert( offset < buffer.get_size() );
 	assert( count_offset < count_buffer.get_size() );
 	_cmd_buffer.drawIndexedIndirectCount( buffer.get_buffer(), offset, count_buffer.get_buffer(), count_offset, max_draws, stride );
@@ -273,6 +568,7 @@ void renderer::CommandBuffer::draw_indexed_indirect( const Buffer& buffer,
 
 void renderer::CommandBuffer::draw_mesh_tasks( uint32_t x, uint32_t y, uint32_t z )
 {
+	flush_barriers();
 	_cmd_buffer.drawMeshTasksEXT( x, y, z );
 }
 
@@ -283,6 +579,7 @@ void renderer::CommandBuffer::draw_mesh_tasks_indirect( const Buffer& buffer,
 														uint32_t max_draws,
 														uint32_t stride )
 {
+	flush_barriers();
 	assert( offset < buffer.get_size() );
 	assert( count_offset < count_buffer.get_size() );
 	_cmd_buffer.drawMeshTasksIndirectCountEXT( buffer.get_buffer(), offset, count_buffer.get_buffer(), count_offset, max_draws, stride );
@@ -290,6 +587,7 @@ void renderer::CommandBuffer::draw_mesh_tasks_indirect( const Buffer& buffer,
 
 void renderer::CommandBuffer::dispatch( uint32_t x, uint32_t y, uint32_t z )
 {
+	flush_barriers();
 	_cmd_buffer.dispatch( x, y, z );
 }
 
@@ -305,6 +603,8 @@ void renderer::CommandBuffer::write_timestamp( TimestampQuery query, uint32_t in
 {
 	if ( query )
 	{
+		// Pending barriers are part of the work being timed
+		flush_barriers();
 		_cmd_buffer.writeTimestamp( vk::PipelineStageFlagBits::eAllGraphics, query, index );
 	}
 }
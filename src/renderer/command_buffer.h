@@ -2,6 +2,7 @@
 
 #include <array>
 #include <optional>
+#include <renderer/barrier.h>
 #include <renderer/common.h>
 #include <renderer/texture.h>
 
@@ -12,6 +13,23 @@ namespace renderer
 	class Pipeline;
 	class TextureView;
 
+	// Region of a buffer copy, sizes in bytes
+	struct BufferCopy
+	{
+		std::size_t src_offset = 0;
+		std::size_t dst_offset = 0;
+		std::size_t size = 0;
+	};
+
+	// Buffer data for a whole mip (tightly packed, layer after layer), extent is deduced from the texture
+	struct BufferTextureCopy
+	{
+		std::size_t buffer_offset = 0;
+		int mip = 0;
+		int base_layer = 0;
+		int layer_count = -1; // All remaining layers
+	};
+
 	struct RenderAttachment
 	{
 		TextureView target;
@@ -22,19 +40,63 @@ namespace renderer
 	class CommandBuffer
 	{
 	public:
+		// Redundant commands skipped since the last begin() because the same state was already bound
+		struct ElidedState
+		{
+			uint32_t pipelines = 0;
+			uint32_t descriptor_sets = 0;
+			uint32_t index_buffers = 0;
+			uint32_t viewports = 0;
+			uint32_t scissors = 0;
+		};
+
 		void begin();
 		void end();
 		void reset();
 
+		// Barriers with precise stage/access masks. They are batched and flushed together by flush_barriers() or
+		// by the next command that needs them (copies, blits, rendering, draws and dispatches)
+		void barrier( const Texture& tex, Access src, Access dst, TextureSubresource range = {} );
+		void barrier( const Texture& tex, Transition transition, TextureSubresource range = {} )
+		{
+			barrier( tex, transition.src, transition.dst, range );
+		}
+		void barrier( const Buffer& buffer, Access src, Access dst, std::size_t offset = 0, std::size_t size = VK_WHOLE_SIZE );
+		void barrier( const Buffer& buffer, Transition transition, std::size_t offset = 0, std::size_t size = VK_WHOLE_SIZE )
+		{
+			barrier( buffer, transition.src, transition.dst, offset, size );
+		}
+		// For callers tracking buffer state themselves (eg: RenderGraph), read-after-read accesses can be merged in src
+		void barrier( const Buffer& buffer,
+					  const AccessInfo& src,
+					  const AccessInfo& dst,
+					  std::size_t offset = 0,
+					  std::size_t size = VK_WHOLE_SIZE );
+		void flush_barriers();
+
+		// Declare how the next commands will use a texture. The barrier is inferred from the texture's tracked state,
+		// skipped if not needed (read after read in the same layout) and batched like the ones above.
+		// Layers are tracked together, only the mip range of the subresource is used.
+		void use_texture( const Texture& tex, Access access, TextureSubresource range = {} );
+
+		// Untracked transition, updates the tracked state to dst_layout
 		void transition_texture( const Texture& tex, Texture::Layout src_layout, Texture::Layout dst_layout, int mip_level = -1 );
 		void blit_texture( const Texture& src, const Texture& dst );
+		// Fills mips 1 to N by blitting each one from the previous, with a linear filter (average).
+		// Needs TRANSFER_SRC and TRANSFER_DST usages and a format supporting linear blits. See MipGenerator for the compute path.
+		void generate_mips( const Texture& tex );
 
 		void copy_buffer( const Buffer& src, std::size_t offset, std::size_t size, const Buffer& dest, std::size_t dest_offset = 0 );
+		void copy_buffer( const Buffer& src, const Buffer& dest, std::span<const BufferCopy> regions );
 		void copy_buffer_to_texture( const Buffer& buffer, std::size_t offset, const Texture& tex );
+		// All regions in a single copy command
+		void copy_buffer_to_texture( const Buffer& buffer, const Texture& tex, std::span<const BufferTextureCopy> regions );
 		void fill_buffer( const Buffer& buffer, size_t offset, size_t size, uint32_t value );
 		void buffer_barrier( const Buffer& buffer );
 
-		void begin_rendering( Extent2D extent, RenderAttachment color_target, RenderAttachment depth_target = {} );
+		// With a view mask (multiview), each set bit renders to the matching layer of the 2D array attachments, the pipeline
+		// must have been created with the same mask (see Pipeline::Desc::view_mask)
+		void begin_rendering( Extent2D extent, RenderAttachment color_target, RenderAttachment depth_target = {}, uint32_t view_mask = 0 );
 		void end_rendering();
 
 		void bind_pipeline( const Pipeline& pipeline, const BindlessManagerBase& bindless_manager );
@@ -48,7 +110,10 @@ namespace renderer
 			push_constants( pipeline, &data, sizeof( T ) );
 		}
 
-		void bind_index_buffer( const Buffer& index_buffer );
+		// Offset must be a multiple of the index size, sub-meshes of a shared buffer can also use first_index
+		void bind_index_buffer( const Buffer& index_buffer,
+								Buffer::IndexType type = Buffer::IndexType::UINT32,
+								std::size_t offset = 0 );
 
 		void draw( uint32_t count );
 		void draw_indexed( uint32_t count, uint32_t instance_count = 1, uint32_t first_index = 0, uint32_t first_instance = 0 );
@@ -80,8 +145,17 @@ namespace renderer
 		void begin_query( StatisticsQuery query );
 		void end_query( StatisticsQuery query );
 
+		const ElidedState& get_elided_state() const { return _elided; }
+		// Forget about bound state, call after recording commands through get_impl()
+		void invalidate_state();
+
 		// Get the underlying renderer buffer, for integration with 3rd party (eg: imgui)
-		VkCommandBuffer get_impl() const { return *_cmd_buffer; }
+		// Flushes pending barriers first so that commands recorded through it are ordered after them
+		VkCommandBuffer get_impl()
+		{
+			flush_barriers();
+			return *_cmd_buffer;
+		}
 
 	private:
 		explicit CommandBuffer( vk::raii::CommandBuffer cmd_buffer )
@@ -96,17 +170,42 @@ namespace renderer
 							  vk::PipelineStageFlags2 dst_stage,
 							  vk::AccessFlags2 src_access,
 							  vk::AccessFlags2 dst_access,
-							  int mip_level = -1 );
+							  TextureSubresource range = {} );
 
 		void buffer_barrier( const Buffer& buffer,
 							 vk::PipelineStageFlags2 src_stage,
 							 vk::PipelineStageFlags2 dst_stage,
 							 vk::AccessFlags2 src_access,
-							 vk::AccessFlags2 dst_access );
+							 vk::AccessFlags2 dst_access,
+							 std::size_t offset = 0,
+							 std::size_t size = VK_WHOLE_SIZE );
 
 		void push_constants( const Pipeline& pipeline, const void* data, std::size_t size );
 
+		struct BoundPipeline
+		{
+			vk::Pipeline pipeline;
+			// Descriptor sets stay valid across pipelines with the same layout (see Device::get_pipeline_layout)
+			vk::PipelineLayout layout;
+			const BindlessManagerBase* bindless_manager = nullptr;
+		};
+
+		struct BoundState
+		{
+			// Indexed by Pipeline::Type
+			std::array<BoundPipeline, 2> pipelines;
+			vk::Buffer index_buffer;
+			vk::DeviceSize index_offset = 0;
+			vk::IndexType index_type = vk::IndexType::eUint32;
+			std::optional<Extent2D> viewport;
+			std::optional<Extent2D> scissor;
+		};
+
 		vk::raii::CommandBuffer _cmd_buffer;
+		std::vector<vk::ImageMemoryBarrier2> _image_barriers;
+		std::vector<vk::BufferMemoryBarrier2> _buffer_barriers;
+		BoundState _bound;
+		ElidedState _elided;
 		void* _optick_previous = nullptr;
 
 		friend class Device;
@@ -4,6 +4,7 @@
 // As a workaround we make sur they are included first
 #include <SDL3/SDL.h>
 #include <array>
+#include <deque>
 #include <expected>
 #include <initializer_list>
 #include <memory>
@@ -90,6 +91,14 @@ namespace vma::raii
 
 	using Buffer = Resource<::VkBuffer>;
 	using Image = Resource<::VkImage>;
+
+	// Raw memory, for resources created with aliasing
+	struct MemoryDeleter
+	{
+		::VmaAllocator allocator;
+		void operator()( ::VmaAllocation allocation ) const { vmaFreeMemory( allocator, allocation ); }
+	};
+	using Memory = std::unique_ptr<::VmaAllocation_T, MemoryDeleter>;
 }
 
 namespace renderer
@@ -99,9 +108,17 @@ namespace renderer
 
 	// Vulkan types that are worth the code to wrap them, it's just handles for us
 	using Fence = ::vk::Fence;
+	using Semaphore = ::vk::Semaphore;
 	using StatisticsQuery = ::vk::QueryPool;
 	using TimestampQuery = ::vk::QueryPool;
 
+	// Point on a timeline semaphore to wait for or signal
+	struct SemaphoreValue
+	{
+		Semaphore semaphore;
+		uint64_t value = 0;
+	};
+
 	class Error : public std::runtime_error
 	{
 	public:
@@ -135,6 +152,7 @@ namespace renderer
 	namespace raii
 	{
 		using Fence = ::vk::raii::Fence;
+		using Semaphore = ::vk::raii::Semaphore;
 		using StatisticsQuery = ::vk::raii::QueryPool;
 		using TimestampQuery = ::vk::raii::QueryPool;
 	}
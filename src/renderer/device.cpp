@@ -3,12 +3,40 @@
 #include <SDL3/SDL_video.h>
 #include <SDL3/SDL_vulkan.h>
 #include <VkBootstrap.h>
+#include <cassert>
 #include <renderer/bindless.h>
 #include <renderer/command_buffer.h>
 #include <renderer/details/profiler.h>
 #include <renderer/pipeline.h>
 #include <renderer/shader.h>
 
+namespace
+{
+	VkImageCreateInfo get_image_create_info( const renderer::Texture::Desc& desc )
+	{
+		using Type = renderer::Texture::Type;
+		assert( desc.type != Type::CUBE || desc.layers % 6 == 0 );
+		assert( desc.type != Type::TEXTURE_3D || desc.layers == 1 );
+		return VkImageCreateInfo { .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+								   .flags = desc.type == Type::CUBE ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : VkImageCreateFlags( 0 ),
+								   .imageType = desc.type == Type::TEXTURE_3D ? VK_IMAGE_TYPE_3D : VK_IMAGE_TYPE_2D,
+								   .format = static_cast<VkFormat>( desc.format ),
+								   .extent = { .width = desc.extent.width,
+											   .height = desc.extent.height,
+											   .depth = static_cast<uint32_t>( desc.depth ) },
+								   .mipLevels = static_cast<uint32_t>( desc.mips ),
+								   .arrayLayers = static_cast<uint32_t>( desc.layers ),
+								   .samples = static_cast<VkSampleCountFlagBits>( desc.samples ),
+								   .tiling = VK_IMAGE_TILING_OPTIMAL,
+								   .usage = static_cast<VkImageUsageFlags>( desc.usage ) };
+	}
+
+	vk::PipelineCreateFlags get_pipeline_flags( const renderer::BindlessManagerBase& bindless_manager )
+	{
+		return bindless_manager.uses_descriptor_buffer() ? vk::PipelineCreateFlagBits::eDescriptorBufferEXT : vk::PipelineCreateFlags {};
+	}
+}
+
 renderer::Device::Device( const char* appname )
 {
 	OPTICK_EVENT();
@@ -64,9 +92,11 @@ renderer::Device::Device( const char* appname )
 	const VkPhysicalDeviceVulkan12Features req_features12 { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
 															.storageBuffer8BitAccess = true,
 															.descriptorIndexing = true,
+															.timelineSemaphore = true,
 															.bufferDeviceAddress = true };
 
 	const VkPhysicalDeviceVulkan11Features req_features11 { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES,
+															.multiview = true,
 															.shaderDrawParameters = true };
 
 	auto physical_device_ret = vkb::PhysicalDeviceSelector( vk_instance_result.value() )
@@ -76,6 +106,9 @@ renderer::Device::Device( const char* appname )
 								   .set_required_features_11( req_features11 )
 								   .set_surface( *_surface )
 								   .add_desired_extension( VK_EXT_MESH_SHADER_EXTENSION_NAME )
+								   .add_desired_extension( VK_EXT_ROBUSTNESS_2_EXTENSION_NAME )
+								   .add_desired_extension( VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME )
+								   .add_desired_extension( VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME )
 								   .select();
 
 	if ( !physical_device_ret )
@@ -96,6 +129,29 @@ renderer::Device::Device( const char* appname )
 		vk::PhysicalDeviceVulkan12Features { .drawIndirectCount = true } );
 	_properties.minmax_filter_support = physical_device_ret.value().enable_extension_features_if_present(
 		vk::PhysicalDeviceVulkan12Features { .samplerFilterMinmax = true } );
+	_properties.bc_compression_support = physical_device_ret.value().enable_features_if_present(
+		vk::PhysicalDeviceFeatures { .textureCompressionBC = true } );
+	_properties.etc2_compression_support = physical_device_ret.value().enable_features_if_present(
+		vk::PhysicalDeviceFeatures { .textureCompressionETC2 = true } );
+	_properties.astc_compression_support = physical_device_ret.value().enable_features_if_present(
+		vk::PhysicalDeviceFeatures { .textureCompressionASTC_LDR = true } );
+	_properties.cube_array_support = physical_device_ret.value().enable_features_if_present(
+		vk::PhysicalDeviceFeatures { .imageCubeArray = true } );
+	_properties.update_after_bind_support = physical_device_ret.value().enable_extension_features_if_present(
+		vk::PhysicalDeviceVulkan12Features { .descriptorBindingSampledImageUpdateAfterBind = true,
+											 .descriptorBindingStorageImageUpdateAfterBind = true,
+											 .descriptorBindingStorageBufferUpdateAfterBind = true,
+											 .descriptorBindingUpdateUnusedWhilePending = true,
+											 .descriptorBindingPartiallyBound = true } );
+	_properties.null_descriptor_support = physical_device_ret->is_extension_present( VK_EXT_ROBUSTNESS_2_EXTENSION_NAME )
+		&& physical_device_ret.value().enable_extension_features_if_present(
+			vk::PhysicalDeviceRobustness2FeaturesEXT { .nullDescriptor = true } );
+	_properties.descriptor_buffer_support = physical_device_ret->is_extension_present( VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME )
+		&& physical_device_ret.value().enable_extension_features_if_present(
+			vk::PhysicalDeviceDescriptorBufferFeaturesEXT { .descriptorBuffer = true } );
+	_properties.index_type_uint8_support = physical_device_ret->is_extension_present( VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME )
+		&& physical_device_ret.value().enable_extension_features_if_present(
+			vk::PhysicalDeviceIndexTypeUint8FeaturesEXT { .indexTypeUint8 = true } );
 
 	vkb::DeviceBuilder device_builder( physical_device_ret.value() );
 	VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_feature { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
@@ -105,6 +161,33 @@ renderer::Device::Device( const char* appname )
 	{
 		device_builder.add_pNext( &mesh_shader_feature );
 	}
+
+	// Async compute uses a second queue of the graphics family, which spares us queue family ownership transfers
+	// Devices that only expose extra queues in a dedicated compute family will run everything on the graphics queue
+	const auto queue_families = physical_device_ret->get_queue_families();
+	uint32_t gfx_family = 0;
+	while ( gfx_family < queue_families.size() && !( queue_families[ gfx_family ].queueFlags & VK_QUEUE_GRAPHICS_BIT ) )
+	{
+		++gfx_family;
+	}
+	if ( gfx_family < queue_families.size() && queue_families[ gfx_family ].queueCount > 1 )
+	{
+		std::vector<vkb::CustomQueueDescription> queues { vkb::CustomQueueDescription( gfx_family, { 1.f, 1.f } ) };
+		for ( uint32_t family = 0; family < queue_families.size(); ++family )
+		{
+			if ( _physical_device.getSurfaceSupportKHR( family, *_surface ) )
+			{
+				if ( family != gfx_family )
+				{
+					queues.push_back( vkb::CustomQueueDescription( family, { 1.f } ) );
+				}
+				break;
+			}
+		}
+		device_builder.custom_queue_setup( std::move( queues ) );
+		_properties.async_compute_support = true;
+	}
+
 	const auto device_ret = device_builder.build();
 	if ( !device_ret )
 	{
@@ -115,6 +198,10 @@ renderer::Device::Device( const char* appname )
 	_gfx_queue_family_index = device_ret.value().get_queue_index( vkb::QueueType::graphics ).value();
 	_present_queue_family_index = device_ret.value().get_queue_index( vkb::QueueType::present ).value();
 	_gfx_queue = _device.getQueue( _gfx_queue_family_index, 0 );
+	if ( _properties.async_compute_support )
+	{
+		_async_compute_queue = _device.getQueue( _gfx_queue_family_index, 1 );
+	}
 
 	VmaAllocator allocator { };
 	const VmaAllocatorCreateInfo allocatorInfo = {
@@ -136,7 +223,6 @@ renderer::Device::Device( const char* appname )
 	auto buffers = _device.allocateCommandBuffers( vk::CommandBufferAllocateInfo { .commandPool = _command_pool,
 																				   .level = vk::CommandBufferLevel::ePrimary,
 																				   .commandBufferCount = MAX_FRAMES_IN_FLIGHT } );
-	_command_buffers.reserve( buffers.size() );
 	for ( auto& buffer : buffers )
 	{
 		_command_buffers.push_back( CommandBuffer( std::move( buffer ) ) );
@@ -160,6 +246,14 @@ void renderer::Device::wait_idle()
 
 renderer::raii::CommandBuffer renderer::Device::grab_command_buffer()
 {
+	if ( _available_command_buffers.empty() )
+	{
+		auto buffers = _device.allocateCommandBuffers( vk::CommandBufferAllocateInfo { .commandPool = _command_pool,
+																					   .level = vk::CommandBufferLevel::ePrimary,
+																					   .commandBufferCount = 1 } );
+		_command_buffers.push_back( CommandBuffer( std::move( buffers.front() ) ) );
+		_available_command_buffers.push( &_command_buffers.back() );
+	}
 	auto cmd = _available_command_buffers.front();
 	_available_command_buffers.pop();
 	return raii::CommandBuffer( cmd, raii::CommandBufferDeleter { this } );
@@ -173,16 +267,7 @@ void renderer::Device::release_command_buffer( CommandBuffer* buffer )
 renderer::raii::Texture renderer::Device::create_texture( const Texture::Desc& desc )
 {
 	OPTICK_EVENT();
-	const VkImageCreateInfo info { .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-								   .imageType = VK_IMAGE_TYPE_2D,
-								   .format = static_cast<VkFormat>( desc.format ),
-								   .extent = { .width = desc.extent.width, .height = desc.extent.height, .depth = 1 },
-								   .mipLevels = static_cast<uint32_t>( desc.mips ),
-								   .arrayLayers = 1,
-								   .samples = static_cast<VkSampleCountFlagBits>( desc.samples ),
-								   .tiling = VK_IMAGE_TILING_OPTIMAL,
-								   .usage = static_cast<VkImageUsageFlags>( desc.usage ) };
-
+	const auto info = get_image_create_info( desc );
 	const VmaAllocationCreateInfo create_info { .usage = VMA_MEMORY_USAGE_AUTO };
 
 	VkImage image { };
@@ -197,18 +282,105 @@ renderer::raii::Texture renderer::Device::create_texture( const Texture::Desc& d
 	return raii::Texture( image, desc, vma::raii::Allocation { _allocator.get(), allocation, allocation_info } );
 }
 
+bool renderer::Device::is_format_supported( Texture::Format format ) const
+{
+	using Format = Texture::Format;
+	switch ( format )
+	{
+		case Format::BC1_RGBA_UNORM:
+		case Format::BC1_RGBA_SRGB:
+		case Format::BC2_UNORM:
+		case Format::BC2_SRGB:
+		case Format::BC3_UNORM:
+		case Format::BC3_SRGB:
+		case Format::BC4_UNORM:
+		case Format::BC4_SNORM:
+		case Format::BC5_UNORM:
+		case Format::BC5_SNORM:
+		case Format::BC6H_UFLOAT:
+		case Format::BC6H_SFLOAT:
+		case Format::BC7_UNORM:
+		case Format::BC7_SRGB:
+			return _properties.bc_compression_support;
+		case Format::ETC2_R8G8B8A8_UNORM:
+		case Format::ETC2_R8G8B8A8_SRGB:
+			return _properties.etc2_compression_support;
+		case Format::ASTC_4x4_UNORM:
+		case Format::ASTC_4x4_SRGB:
+			return _properties.astc_compression_support;
+		default:
+			return true;
+	}
+}
+
+vk::MemoryRequirements renderer::Device::get_memory_requirements( const Texture::Desc& desc ) const
+{
+	const auto info = get_image_create_info( desc );
+	const vk::DeviceImageMemoryRequirements requirements_info { .pCreateInfo = reinterpret_cast<const vk::ImageCreateInfo*>( &info ) };
+	return _device.getImageMemoryRequirements( requirements_info ).memoryRequirements;
+}
+
+vma::raii::Memory renderer::Device::allocate_memory( const vk::MemoryRequirements& requirements )
+{
+	OPTICK_EVENT();
+	const VkMemoryRequirements vk_requirements = requirements;
+	const VmaAllocationCreateInfo create_info { .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT };
+
+	VmaAllocation allocation { };
+	const auto ret = vmaAllocateMemory( _allocator.get(), &vk_requirements, &create_info, &allocation, nullptr );
+	if ( ret )
+	{
+		throw Error( "Failed to allocate memory", ret );
+	}
+	return vma::raii::Memory( allocation, vma::raii::MemoryDeleter { _allocator.get() } );
+}
+
+renderer::raii::Texture
+renderer::Device::create_aliased_texture( const Texture::Desc& desc, const vma::raii::Memory& memory, std::size_t offset )
+{
+	OPTICK_EVENT();
+	const auto info = get_image_create_info( desc );
+
+	VkImage image { };
+	const auto ret = vmaCreateAliasingImage2( _allocator.get(), memory.get(), offset, &info, &image );
+	if ( ret )
+	{
+		throw Error( "Failed to create aliased image", ret );
+	}
+
+	// No allocation, destroying the texture leaves the memory alone
+	return raii::Texture( image, desc, vma::raii::Allocation { _allocator.get(), nullptr, { } } );
+}
+
 renderer::raii::TextureView renderer::Device::create_texture_view( const Texture& texture, TextureView::Aspect aspect, int mip_level )
 {
-	const vk::ImageViewCreateInfo image_view_info { .image = texture._image,
-													.viewType = vk::ImageViewType::e2D,
-													.format = static_cast<vk::Format>( texture.get_format() ),
-													.subresourceRange = {
-														.aspectMask = static_cast<vk::ImageAspectFlagBits>( aspect ),
-														.baseMipLevel = static_cast<uint32_t>( mip_level == -1 ? 0 : mip_level ),
-														.levelCount = mip_level == -1 ? VK_REMAINING_MIP_LEVELS : 1,
-														.baseArrayLayer = 0,
-														.layerCount = 1 } };
+	return create_texture_view( texture,
+								aspect,
+								TextureView::get_default_type( texture ),
+								{ .base_mip = mip_level == -1 ? 0 : mip_level, .mip_count = mip_level == -1 ? -1 : 1 } );
+}
+
+renderer::raii::TextureView renderer::Device::create_texture_view( const Texture& texture,
+																   TextureView::Aspect aspect,
+																   TextureView::Type type,
+																   TextureSubresource range )
+{
+	if ( type == TextureView::Type::CUBE_ARRAY && !_properties.cube_array_support )
+	{
+		throw Error( "Cube array views are not supported by the device" );
+	}
 
+	const vk::ImageViewCreateInfo image_view_info {
+		.image = texture._image,
+		.viewType = static_cast<vk::ImageViewType>( type ),
+		.format = static_cast<vk::Format>( texture.get_format() ),
+		.subresourceRange = { .aspectMask = static_cast<vk::ImageAspectFlagBits>( aspect ),
+							  .baseMipLevel = static_cast<uint32_t>( range.base_mip ),
+							  .levelCount = range.mip_count == -1 ? VK_REMAINING_MIP_LEVELS : static_cast<uint32_t>( range.mip_count ),
+							  .baseArrayLayer = static_cast<uint32_t>( range.base_layer ),
+							  .layerCount = range.layer_count == -1 ? VK_REMAINING_ARRAY_LAYERS
+																	: static_cast<uint32_t>( range.layer_count ) }
+	};
 
 	auto view = _device.createImageView( image_view_info );
 	return raii::TextureView( std::move( view ) );
@@ -226,15 +398,24 @@ renderer::raii::Sampler renderer::Device::create_sampler( Sampler::Filter filter
 }
 
 renderer::raii::Buffer renderer::Device::create_buffer( Buffer::Usage usage, std::size_t size, bool upload )
+{
+	return allocate_buffer( usage,
+							size,
+							upload ? ( VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT ) : 0u );
+}
+
+renderer::raii::Buffer renderer::Device::create_readback_buffer( Buffer::Usage usage, std::size_t size )
+{
+	return allocate_buffer( usage, size, VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT );
+}
+
+renderer::raii::Buffer renderer::Device::allocate_buffer( Buffer::Usage usage, std::size_t size, VmaAllocationCreateFlags flags )
 {
 	OPTICK_EVENT();
 	const VkBufferCreateInfo buffer_Info { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 										   .size = size,
 										   .usage = static_cast<VkBufferUsageFlags>( usage ) };
-	const VmaAllocationCreateInfo vma_alloc_info = {
-		.flags = upload ? ( VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT ) : 0u,
-		.usage = VMA_MEMORY_USAGE_AUTO
-	};
+	const VmaAllocationCreateInfo vma_alloc_info = { .flags = flags, .usage = VMA_MEMORY_USAGE_AUTO };
 
 	VkBuffer buffer { };
 	VmaAllocation allocation { };
@@ -255,19 +436,31 @@ renderer::raii::Buffer renderer::Device::create_buffer( Buffer::Usage usage, std
 						 vma::raii::Allocation { _allocator.get(), allocation, allocation_info } );
 }
 
-vk::raii::PipelineLayout renderer::Device::create_pipeline_layout( vk::ShaderStageFlags used_stages,
-																   uint32_t push_constants_size,
-																   const BindlessManagerBase& bindless_manager )
+vk::PipelineLayout renderer::Device::get_pipeline_layout( vk::ShaderStageFlags used_stages,
+														  uint32_t push_constants_size,
+														  const BindlessManagerBase& bindless_manager )
 {
-	const vk::PushConstantRange constants { .stageFlags = used_stages, .size = push_constants_size };
 	const auto desc_layouts = bindless_manager.get_layouts();
+	PipelineLayoutKey key { .stages = static_cast<VkShaderStageFlags>( used_stages ),
+							.push_constants_size = push_constants_size,
+							.set_layouts = { begin( desc_layouts ), end( desc_layouts ) } };
+
+	// Pipelines are built from the PipelineManager rebuild thread as well as the main thread
+	std::unique_lock lock( _pipeline_layouts_mtx );
+	if ( const auto it = _pipeline_layouts.find( key ); it != end( _pipeline_layouts ) )
+	{
+		return it->second;
+	}
+
+	const vk::PushConstantRange constants { .stageFlags = used_stages, .size = push_constants_size };
 	vk::PipelineLayoutCreateInfo layout_create_info { .setLayoutCount = desc_layouts.size(), .pSetLayouts = desc_layouts.data() };
 	if ( constants.size > 0 )
 	{
 		layout_create_info.pushConstantRangeCount = 1;
 		layout_create_info.pPushConstantRanges = &constants;
 	}
-	return _device.createPipelineLayout( layout_create_info );
+	const auto [ it, inserted ] = _pipeline_layouts.emplace( std::move( key ), _device.createPipelineLayout( layout_create_info ) );
+	return it->second;
 }
 
 renderer::raii::Pipeline renderer::Device::create_graphics_pipeline( const Pipeline::Desc& desc,
@@ -282,7 +475,7 @@ renderer::raii::Pipeline renderer::Device::create_graphics_pipeline( const Pipel
 		used_stages |= static_cast<vk::ShaderStageFlagBits>( shader->get_source().stage );
 	}
 
-	auto layout = create_pipeline_layout( used_stages, desc.push_constants_size, bindless_manager );
+	const auto layout = get_pipeline_layout( used_stages, desc.push_constants_size, bindless_manager );
 
 	const vk::PipelineVertexInputStateCreateInfo vertex_input;
 	const vk::PipelineInputAssemblyStateCreateInfo ia { .topology = static_cast<vk::PrimitiveTopology>( desc.topology ) };
@@ -304,7 +497,8 @@ renderer::raii::Pipeline renderer::Device::create_graphics_pipeline( const Pipel
 																.attachmentCount = 1,
 																.pAttachments = &blend_attachment };
 	const auto color_format = static_cast<vk::Format>( desc.color_format );
-	const vk::PipelineRenderingCreateInfo render_info { .colorAttachmentCount = 1,
+	const vk::PipelineRenderingCreateInfo render_info { .viewMask = desc.view_mask,
+														.colorAttachmentCount = 1,
 														.pColorAttachmentFormats = &color_format,
 														.depthAttachmentFormat = static_cast<vk::Format>( desc.depth_format ) };
 
@@ -322,6 +516,7 @@ renderer::raii::Pipeline renderer::Device::create_graphics_pipeline( const Pipel
 	}
 
 	const vk::GraphicsPipelineCreateInfo pipeline_info = { .pNext = &render_info,
+														   .flags = get_pipeline_flags( bindless_manager ),
 														   .stageCount = static_cast<uint32_t>( shader_stages.size() ),
 														   .pStages = shader_stages.data(),
 														   .pVertexInputState = &vertex_input,
@@ -336,7 +531,7 @@ renderer::raii::Pipeline renderer::Device::create_graphics_pipeline( const Pipel
 
 	auto pipeline = _device.createGraphicsPipeline( nullptr, pipeline_info );
 
-	return raii::Pipeline( std::move( layout ), std::move( pipeline ), desc, used_stages, Pipeline::Type::Graphics );
+	return raii::Pipeline( layout, std::move( pipeline ), desc, used_stages, Pipeline::Type::Graphics );
 }
 
 renderer::raii::Pipeline renderer::Device::create_compute_pipeline( const Pipeline::Desc& desc,
@@ -344,18 +539,19 @@ renderer::raii::Pipeline renderer::Device::create_compute_pipeline( const Pipeli
 																	const BindlessManagerBase& bindless_manager )
 {
 	const vk::ShaderStageFlags used_stages = vk::ShaderStageFlagBits::eCompute;
-	auto layout = create_pipeline_layout( used_stages, desc.push_constants_size, bindless_manager );
+	const auto layout = get_pipeline_layout( used_stages, desc.push_constants_size, bindless_manager );
 
 	const auto shader_module = _device.createShaderModule( { .codeSize = shader.get_size_bytes(), .pCode = shader.get_data() } );
 
 	const vk::ComputePipelineCreateInfo info {
+		.flags = get_pipeline_flags( bindless_manager ),
 		.stage { .stage = vk::ShaderStageFlagBits::eCompute, .module = shader_module, .pName = "main" },
 		.layout = layout
 	};
 
 	auto pipeline = _device.createComputePipeline( nullptr, info );
 
-	return raii::Pipeline( std::move( layout ), std::move( pipeline ), desc, used_stages, Pipeline::Type::Compute );
+	return raii::Pipeline( layout, std::move( pipeline ), desc, used_stages, Pipeline::Type::Compute );
 }
 
 renderer::raii::Fence renderer::Device::create_fence( bool signaled )
@@ -372,6 +568,16 @@ void renderer::Device::wait_for_fences( std::span<const Fence> fences, uint64_t
 	(void)_device.waitForFences( fences, true, timeout );
 }
 
+bool renderer::Device::get_fence_status( Fence fence ) const
+{
+	const auto result = _device.getDispatcher()->vkGetFenceStatus( *_device, fence );
+	if ( result != VK_SUCCESS && result != VK_NOT_READY )
+	{
+		throw Error( "Failed to get fence status", result );
+	}
+	return result == VK_SUCCESS;
+}
+
 void renderer::Device::reset_fences( std::span<const Fence> fences )
 {
 	_device.resetFences( fences );
@@ -384,6 +590,66 @@ void renderer::Device::submit( CommandBuffer& buffer, vk::Fence signal_fence )
 	_gfx_queue.submit2( vk::SubmitInfo2 { .commandBufferInfoCount = 1, .pCommandBufferInfos = &info }, signal_fence );
 }
 
+void renderer::Device::submit( Queue queue,
+								CommandBuffer& buffer,
+								std::span<const SemaphoreValue> waits,
+								std::span<const SemaphoreValue> signals,
+								Fence signal_fence )
+{
+	OPTICK_EVENT();
+	assert( queue == Queue::GRAPHICS || _properties.async_compute_support );
+
+	std::vector<vk::SemaphoreSubmitInfo> wait_infos;
+	wait_infos.reserve( waits.size() );
+	for ( const auto& wait : waits )
+	{
+		wait_infos.push_back(
+			{ .semaphore = wait.semaphore, .value = wait.value, .stageMask = vk::PipelineStageFlagBits2::eAllCommands } );
+	}
+	std::vector<vk::SemaphoreSubmitInfo> signal_infos;
+	signal_infos.reserve( signals.size() );
+	for ( const auto& signal : signals )
+	{
+		signal_infos.push_back(
+			{ .semaphore = signal.semaphore, .value = signal.value, .stageMask = vk::PipelineStageFlagBits2::eAllCommands } );
+	}
+
+	const vk::CommandBufferSubmitInfo info { .commandBuffer = buffer._cmd_buffer };
+	auto& vk_queue = queue == Queue::ASYNC_COMPUTE ? _async_compute_queue : _gfx_queue;
+	vk_queue.submit2( vk::SubmitInfo2 { .waitSemaphoreInfoCount = static_cast<uint32_t>( wait_infos.size() ),
+										.pWaitSemaphoreInfos = wait_infos.data(),
+										.commandBufferInfoCount = 1,
+										.pCommandBufferInfos = &info,
+										.signalSemaphoreInfoCount = static_cast<uint32_t>( signal_infos.size() ),
+										.pSignalSemaphoreInfos = signal_infos.data() },
+					  signal_fence );
+}
+
+renderer::raii::Semaphore renderer::Device::create_timeline_semaphore( uint64_t initial_value )
+{
+	const vk::SemaphoreTypeCreateInfo type_info { .semaphoreType = vk::SemaphoreType::eTimeline, .initialValue = initial_value };
+	return _device.createSemaphore( vk::SemaphoreCreateInfo { .pNext = &type_info } );
+}
+
+void renderer::Device::wait_for_semaphores( std::span<const SemaphoreValue> values, uint64_t timeout )
+{
+	OPTICK_EVENT();
+	std::vector<vk::Semaphore> semaphores;
+	std::vector<uint64_t> semaphore_values;
+	semaphores.reserve( values.size() );
+	semaphore_values.reserve( values.size() );
+	for ( const auto& value : values )
+	{
+		semaphores.push_back( value.semaphore );
+		semaphore_values.push_back( value.value );
+	}
+	// Same as fences, VulkanHpp already throws an exception on failure
+	(void)_device.waitSemaphores( vk::SemaphoreWaitInfo { .semaphoreCount = static_cast<uint32_t>( semaphores.size() ),
+														  .pSemaphores = semaphores.data(),
+														  .pValues = semaphore_values.data() },
+								  timeout );
+}
+
 renderer::raii::TimestampQuery renderer::Device::create_timestamp_query( uint32_t size )
 {
 	return _device.createQueryPool( vk::QueryPoolCreateInfo { .queryType = vk::QueryType::eTimestamp, .queryCount = size } );
@@ -443,7 +709,36 @@ void renderer::Device::set_relative_mouse_mode( bool enabled )
 
 void renderer::Device::queue_deletion( raii::Pipeline pipeline )
 {
-	_delete_queue[ _delete_index ].push_back( std::move( pipeline ) );
+	_delete_queue[ _delete_index ].pipelines.push_back( std::move( pipeline ) );
+}
+
+void renderer::Device::queue_deletion( raii::Texture texture )
+{
+	_delete_queue[ _delete_index ].textures.push_back( std::move( texture ) );
+}
+
+void renderer::Device::queue_deletion( raii::TextureView view )
+{
+	_delete_queue[ _delete_index ].views.push_back( std::move( view ) );
+}
+
+void renderer::Device::queue_deletion( raii::Buffer buffer )
+{
+	_delete_queue[ _delete_index ].buffers.push_back( std::move( buffer ) );
+}
+
+void renderer::Device::queue_deletion( vma::raii::Memory memory )
+{
+	_delete_queue[ _delete_index ].memory.push_back( std::move( memory ) );
+}
+
+void renderer::Device::DeleteQueue::clear()
+{
+	pipelines.clear();
+	views.clear();
+	textures.clear();
+	buffers.clear();
+	memory.clear();
 }
 
 renderer::Device::Internals renderer::Device::get_internals() const
@@ -466,12 +761,32 @@ void renderer::Device::notify_present()
 
 void renderer::Device::set_properties()
 {
-	const auto props_chain = _physical_device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceMeshShaderPropertiesEXT>();
+	const auto props_chain = _physical_device.getProperties2<vk::PhysicalDeviceProperties2,
+															 vk::PhysicalDeviceVulkan11Properties,
+															 vk::PhysicalDeviceVulkan12Properties,
+															 vk::PhysicalDeviceMeshShaderPropertiesEXT,
+															 vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
 	_properties.name = props_chain.get<vk::PhysicalDeviceProperties2>().properties.deviceName.data();
 
 	const auto& mesh_shader_props = props_chain.get<vk::PhysicalDeviceMeshShaderPropertiesEXT>();
 	_properties.max_mesh_shader_groups = mesh_shader_props.maxMeshWorkGroupTotalCount;
 	_properties.max_mesh_shader_group_size = mesh_shader_props.maxMeshWorkGroupCount;
+	_properties.max_mesh_output_vertices = mesh_shader_props.maxMeshOutputVertices;
+	_properties.max_mesh_output_primitives = mesh_shader_props.maxMeshOutputPrimitives;
+	_properties.max_multiview_views = props_chain.get<vk::PhysicalDeviceVulkan11Properties>().maxMultiviewViewCount;
+	// Lowest of the regular and update after bind limits, whichever the bindless manager ends up using
+	const auto& limits = props_chain.get<vk::PhysicalDeviceProperties2>().properties.limits;
+	const auto& props12 = props_chain.get<vk::PhysicalDeviceVulkan12Properties>();
+	_properties.max_bindless_textures = std::min( { limits.maxPerStageDescriptorSampledImages,
+													limits.maxPerStageDescriptorStorageImages,
+													limits.maxDescriptorSetSampledImages,
+													limits.maxDescriptorSetStorageImages,
+													props12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+													props12.maxPerStageDescriptorUpdateAfterBindStorageImages,
+													props12.maxDescriptorSetUpdateAfterBindSampledImages,
+													props12.maxDescriptorSetUpdateAfterBindStorageImages } );
+	_descriptor_buffer_properties = props_chain.get<vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
+	_descriptor_buffer_properties.pNext = nullptr;
 
 	static constexpr auto bar_flags = vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible;
 	static constexpr auto gpu_flags = vk::MemoryPropertyFlagBits::eDeviceLocal;
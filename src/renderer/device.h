@@ -2,7 +2,10 @@
 
 #include <array>
 #include <initializer_list>
+#include <map>
+#include <mutex>
 #include <queue>
+#include <renderer/barrier.h>
 #include <renderer/buffer.h>
 #include <renderer/common.h>
 #include <renderer/pipeline.h>
@@ -37,20 +40,42 @@ namespace renderer
 	class Device
 	{
 	public:
+		enum class Queue
+		{
+			GRAPHICS,
+			// Second queue from the graphics family, only if Properties::async_compute_support is set
+			ASYNC_COMPUTE
+		};
+
 		explicit Device( const char* appname );
 		~Device();
 
 		void wait_idle();
 
+		// Command buffers are allocated on demand, not thread safe
 		raii::CommandBuffer grab_command_buffer();
 		void release_command_buffer( CommandBuffer* buffer );
 
 		raii::Texture create_texture( const Texture::Desc& desc );
+		// False for block compressed formats the device lacks (see Properties::*_compression_support)
+		bool is_format_supported( Texture::Format format ) const;
+		// Memory that can be shared by multiple textures, see create_aliased_texture()
+		vk::MemoryRequirements get_memory_requirements( const Texture::Desc& desc ) const;
+		vma::raii::Memory allocate_memory( const vk::MemoryRequirements& requirements );
+		// Texture bound to existing memory at the given offset, the memory must outlive it.
+		// Textures sharing memory need barriers between their uses like any other (see TransientPool).
+		raii::Texture create_aliased_texture( const Texture::Desc& desc, const vma::raii::Memory& memory, std::size_t offset );
+		// All layers, with the default view type of the texture (see TextureView::get_default_type())
 		raii::TextureView create_texture_view( const Texture& texture, TextureView::Aspect aspect, int mip_level = -1 );
+		// Eg: a 2D array view of a cube to render all its faces with multiview, or a single layer of an array
+		raii::TextureView
+		create_texture_view( const Texture& texture, TextureView::Aspect aspect, TextureView::Type type, TextureSubresource range = {} );
 
 		raii::Sampler create_sampler( Sampler::Filter filter, Sampler::ReductionMode mode = Sampler::ReductionMode::AVERAGE );
 
 		raii::Buffer create_buffer( Buffer::Usage usage, std::size_t size, bool upload = false );
+		// Mapped and cached host memory for reading back GPU results
+		raii::Buffer create_readback_buffer( Buffer::Usage usage, std::size_t size );
 
 		raii::Pipeline create_graphics_pipeline( const Pipeline::Desc& desc,
 												 std::span<const raii::ShaderCode*> shaders,
@@ -65,10 +90,21 @@ namespace renderer
 		{
 			wait_for_fences( std::span( begin( fences ), fences.size() ), timeout );
 		}
+		// Non-blocking, true if signaled
+		bool get_fence_status( Fence fence ) const;
 		void reset_fences( std::span<const Fence> fences );
 		void reset_fences( std::initializer_list<Fence> fences ) { reset_fences( std::span( begin( fences ), fences.size() ) ); }
 
 		void submit( CommandBuffer& buffer, Fence signal_fence );
+		// Waits block all stages of the submitted commands, signals happen once they are complete
+		void submit( Queue queue,
+					 CommandBuffer& buffer,
+					 std::span<const SemaphoreValue> waits,
+					 std::span<const SemaphoreValue> signals,
+					 Fence signal_fence = { } );
+
+		raii::Semaphore create_timeline_semaphore( uint64_t initial_value = 0 );
+		void wait_for_semaphores( std::span<const SemaphoreValue> values, uint64_t timeout );
 
 		raii::TimestampQuery create_timestamp_query( uint32_t size );
 		void get_query_results( TimestampQuery query, uint32_t first_index, std::span<uint64_t> results ); // no-op on nil query
@@ -83,6 +119,10 @@ namespace renderer
 
 		// Queue resource for deletion once MAX_FRAMES_IN_FLIGHT have been submitted for presentation
 		void queue_deletion( raii::Pipeline pipeline );
+		void queue_deletion( raii::Texture texture );
+		void queue_deletion( raii::TextureView view );
+		void queue_deletion( raii::Buffer buffer );
+		void queue_deletion( vma::raii::Memory memory );
 
 		// Renderer internals, can be queried if needed to interact with a 3rd party (eg: imgui)
 		struct Internals
@@ -107,16 +147,49 @@ namespace renderer
 			bool mesh_shader_support = false;
 			uint32_t max_mesh_shader_groups = 0;
 			std::array<uint32_t, 3> max_mesh_shader_group_size;
+			// Per mesh shader workgroup, limits meshlet sizes
+			uint32_t max_mesh_output_vertices = 0;
+			uint32_t max_mesh_output_primitives = 0;
+			uint32_t max_multiview_views = 0;
 			bool draw_indirect_count_support = false;
 			bool minmax_filter_support = false;
+			bool async_compute_support = false;
+			// Block compressed texture formats, BC is desktop only, ETC2 and ASTC mostly mobile
+			bool bc_compression_support = false;
+			bool etc2_compression_support = false;
+			bool astc_compression_support = false;
+			// Cube array views, textures with more than 6 cube layers need it
+			bool cube_array_support = false;
+			// Descriptors can point to VK_NULL_HANDLE (VK_EXT_robustness2)
+			bool null_descriptor_support = false;
+			// VK_EXT_descriptor_buffer, see BindlessManagerBase::Backend
+			bool descriptor_buffer_support = false;
+			// Bindless descriptors can be updated while frames using them are in flight, and left unwritten
+			bool update_after_bind_support = false;
+			uint32_t max_bindless_textures = 0;
+			// Buffer::IndexType::UINT8 (VK_EXT_index_type_uint8)
+			bool index_type_uint8_support = false;
 		};
 
 		const Properties& get_properties() const { return _properties; }
 
 	private:
-		vk::raii::PipelineLayout create_pipeline_layout( vk::ShaderStageFlags used_stages,
-														 uint32_t push_constants_size,
-														 const BindlessManagerBase& bindless_manager );
+		raii::Buffer allocate_buffer( Buffer::Usage usage, std::size_t size, VmaAllocationCreateFlags flags );
+
+		struct PipelineLayoutKey
+		{
+			VkShaderStageFlags stages;
+			uint32_t push_constants_size;
+			std::vector<VkDescriptorSetLayout> set_layouts;
+
+			auto operator<=>( const PipelineLayoutKey& other ) const = default;
+		};
+
+		// Layouts are cached and shared by all pipelines with the same stages and push constants, they live as long as the device.
+		// Pipelines sharing a layout are compatible, which lets command buffers keep descriptor sets bound across pipeline switches.
+		vk::PipelineLayout get_pipeline_layout( vk::ShaderStageFlags used_stages,
+												uint32_t push_constants_size,
+												const BindlessManagerBase& bindless_manager );
 
 		void notify_present();
 		void set_properties();
@@ -129,15 +202,30 @@ namespace renderer
 		vk::raii::SurfaceKHR _surface = nullptr;
 		vk::raii::PhysicalDevice _physical_device = nullptr;
 		Properties _properties;
+		vk::PhysicalDeviceDescriptorBufferPropertiesEXT _descriptor_buffer_properties;
 		vk::raii::Device _device = nullptr;
 		uint32_t _gfx_queue_family_index = 0;
 		uint32_t _present_queue_family_index = 0;
 		vk::raii::Queue _gfx_queue = nullptr;
+		vk::raii::Queue _async_compute_queue = nullptr;
 		vma::raii::Allocator _allocator;
 		vk::raii::CommandPool _command_pool = nullptr;
-		std::vector<CommandBuffer> _command_buffers;
+		std::deque<CommandBuffer> _command_buffers;
 		std::queue<CommandBuffer*> _available_command_buffers;
-		std::array<std::vector<raii::Pipeline>, MAX_FRAMES_IN_FLIGHT> _delete_queue;
+		std::map<PipelineLayoutKey, vk::raii::PipelineLayout> _pipeline_layouts;
+		std::mutex _pipeline_layouts_mtx;
+		struct DeleteQueue
+		{
+			// First so it is destroyed last, aliased textures may still use it
+			std::vector<vma::raii::Memory> memory;
+			std::vector<raii::Pipeline> pipelines;
+			std::vector<raii::Texture> textures;
+			std::vector<raii::TextureView> views;
+			std::vector<raii::Buffer> buffers;
+
+			void clear();
+		};
+		std::array<DeleteQueue, MAX_FRAMES_IN_FLIGHT> _delete_queue;
 		uint32_t _delete_index = 0;
 
 		friend class BindlessManagerBase;
@@ -0,0 +1,43 @@
+#include "frame_allocator.h"
+
+#include <bit>
+#include <cassert>
+#include <renderer/device.h>
+
+renderer::FrameAllocator::FrameAllocator( Device& device, std::size_t capacity_per_frame, Buffer::Usage usage )
+{
+	for ( uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; ++frame )
+	{
+		_buffers[ frame ] = device.create_buffer( usage | Buffer::Usage::SHADER_DEVICE_ADDRESS, capacity_per_frame, true );
+		_mapped[ frame ] = static_cast<std::byte*>( _buffers[ frame ].get_mapped_address() );
+	}
+}
+
+void renderer::FrameAllocator::begin_frame( uint32_t frame_index )
+{
+	assert( frame_index < MAX_FRAMES_IN_FLIGHT );
+	_frame_index = frame_index;
+	_head.store( 0, std::memory_order_relaxed );
+}
+
+renderer::FrameAllocator::Allocation renderer::FrameAllocator::allocate( std::size_t size, std::size_t alignment )
+{
+	assert( std::has_single_bit( alignment ) );
+	const auto capacity = _buffers[ _frame_index ].get_size();
+
+	// Alignment depends on the previous head, so a compare and swap rather than a fetch add
+	auto head = _head.load( std::memory_order_relaxed );
+	std::size_t offset;
+	do
+	{
+		offset = ( head + alignment - 1 ) & ~( alignment - 1 );
+		if ( offset + size > capacity )
+		{
+			throw Error( "Frame allocator out of space" );
+		}
+	} while ( !_head.compare_exchange_weak( head, offset + size, std::memory_order_relaxed ) );
+
+	return { .data = _mapped[ _frame_index ] + offset,
+			 .address = _buffers[ _frame_index ].get_device_address() + offset,
+			 .offset = offset };
+}
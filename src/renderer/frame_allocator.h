@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <renderer/buffer.h>
+#include <renderer/common.h>
+
+namespace renderer
+{
+	class Device;
+
+	// Bump allocator for data that lives for a single frame (per draw constants, instance lists, indirect arguments...),
+	// over one persistently mapped buffer per frame in flight. Shaders read allocations through their device address.
+	// allocate() is lock free and can be called from several recording threads, begin_frame() must not run concurrently.
+	class FrameAllocator
+	{
+	public:
+		struct Allocation
+		{
+			void* data = nullptr;
+			vk::DeviceAddress address = 0;
+			std::size_t offset = 0; // In get_buffer(), eg: for indirect arguments
+		};
+
+		FrameAllocator( Device& device,
+						std::size_t capacity_per_frame = 16 * 1024 * 1024,
+						Buffer::Usage usage = Buffer::Usage::STORAGE_BUFFER | Buffer::Usage::UNIFORM_BUFFER | Buffer::Usage::INDEX_BUFFER
+							| Buffer::Usage::INDIRECT_BUFFER );
+
+		// Call before recording the frame, once its previous use with the same index has completed.
+		// Previous allocations of that frame are released.
+		void begin_frame( uint32_t frame_index );
+
+		// Throws renderer::Error if the frame's buffer is full
+		Allocation allocate( std::size_t size, std::size_t alignment = 16 );
+
+		template <typename T>
+		Allocation allocate( std::span<const T> values, std::size_t alignment = alignof( T ) )
+		{
+			const auto allocation = allocate( values.size_bytes(), std::max<std::size_t>( alignment, 4 ) );
+			std::memcpy( allocation.data, values.data(), values.size_bytes() );
+			return allocation;
+		}
+
+		Buffer get_buffer() const { return _buffers[ _frame_index ]; }
+		std::size_t get_capacity() const { return _buffers[ _frame_index ].get_size(); }
+		std::size_t get_used_size() const { return _head.load( std::memory_order_relaxed ); }
+
+	private:
+		std::array<raii::Buffer, MAX_FRAMES_IN_FLIGHT> _buffers;
+		std::array<std::byte*, MAX_FRAMES_IN_FLIGHT> _mapped = {};
+		std::atomic<std::size_t> _head = 0;
+		uint32_t _frame_index = 0;
+	};
+}
@@ -0,0 +1,309 @@
+#include "gpu_culler.h"
+
+#include <initializer_list>
+#include <renderer/details/profiler.h>
+#include <renderer/device.h>
+
+namespace
+{
+	constexpr uint32_t GROUP_SIZE = 64;
+	// Pass counts come first, padded to 16 bytes
+	constexpr uint32_t HEADER_WORDS = 4;
+	constexpr uint32_t NO_HIZ = ~0u;
+
+	// VkDrawIndexedIndirectCommand and VkDrawMeshTasksIndirectCommandEXT
+	constexpr uint32_t DRAW_INDEXED_WORDS = 5;
+	constexpr uint32_t MESH_TASKS_WORDS = 3;
+
+	constexpr const char* CULL_SHADER = R"(
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+layout( local_size_x = 64 ) in;
+
+struct Instance
+{
+	vec4 bounding_sphere;
+	uint count;
+	uint first_index;
+	int vertex_offset;
+	uint padding;
+};
+
+layout( set = 0, binding = 0 ) uniform texture2D textures[];
+layout( set = 0, binding = 2 ) uniform sampler samplers[];
+
+layout( set = 1, binding = INSTANCE_BINDING ) readonly buffer Instances
+{
+	Instance instances[];
+};
+
+layout( buffer_reference, std430, buffer_reference_align = 4 ) buffer State
+{
+	uint words[];
+};
+
+layout( push_constant ) uniform Constants
+{
+	mat4 view;
+	vec4 projection; // p00, p11, z near, z far
+	vec2 viewport;
+	uint small_primitive_culling;
+	uint hiz_index;
+	State state;
+	uint instance_count;
+	uint max_instances;
+	uint pass;
+	uint padding;
+};
+
+#if MESH_TASKS
+const uint COMMAND_WORDS = 3;
+#else
+const uint COMMAND_WORDS = 5;
+#endif
+
+const uint VISIBILITY = 4;
+
+// 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere. Michael Mara, Morgan McGuire. 2013
+// UV space bounds of a view space sphere, which must be entirely in front of the near plane
+vec4 project_sphere( vec3 c, float r )
+{
+	const vec2 cx = -c.xz;
+	const vec2 vx = vec2( sqrt( dot( cx, cx ) - r * r ), r );
+	const vec2 min_x = mat2( vx.x, vx.y, -vx.y, vx.x ) * cx;
+	const vec2 max_x = mat2( vx.x, -vx.y, vx.y, vx.x ) * cx;
+
+	const vec2 cy = -c.yz;
+	const vec2 vy = vec2( sqrt( dot( cy, cy ) - r * r ), r );
+	const vec2 min_y = mat2( vy.x, vy.y, -vy.y, vy.x ) * cy;
+	const vec2 max_y = mat2( vy.x, -vy.y, vy.y, vy.x ) * cy;
+
+	const vec4 aabb = vec4( min_x.x / min_x.y * projection.x,
+							min_y.x / min_y.y * projection.y,
+							max_x.x / max_x.y * projection.x,
+							max_y.x / max_y.y * projection.y );
+	return aabb.xwzy * vec4( 0.5, -0.5, 0.5, -0.5 ) + vec4( 0.5 );
+}
+
+// The Hi-Z holds the farthest depth of each texel (min, with reverse Z)
+bool is_occluded( vec4 aabb, float depth )
+{
+	const ivec2 size = textureSize( sampler2D( textures[ hiz_index ], samplers[ 0 ] ), 0 );
+	const vec2 extent = ( aabb.zw - aabb.xy ) * vec2( size );
+	const int levels = textureQueryLevels( sampler2D( textures[ hiz_index ], samplers[ 0 ] ) );
+	const int level = clamp( int( ceil( log2( max( max( extent.x, extent.y ), 1.0 ) ) ) ), 0, levels - 1 );
+
+	// At that level the bounds cover at most 2x2 texels. Pyramid extents are powers of two (see HiZBuilder), each level
+	// is exactly half the previous one and its texels cover the same fraction of the screen.
+	const ivec2 level_size = max( size >> level, ivec2( 1 ) );
+	const ivec2 p = clamp( ivec2( aabb.xy * vec2( level_size ) ), ivec2( 0 ), level_size - 1 );
+	const ivec2 q = min( p + 1, level_size - 1 );
+	const float hiz = min( min( texelFetch( sampler2D( textures[ hiz_index ], samplers[ 0 ] ), p, level ).x,
+								texelFetch( sampler2D( textures[ hiz_index ], samplers[ 0 ] ), ivec2( q.x, p.y ), level ).x ),
+						   min( texelFetch( sampler2D( textures[ hiz_index ], samplers[ 0 ] ), ivec2( p.x, q.y ), level ).x,
+								texelFetch( sampler2D( textures[ hiz_index ], samplers[ 0 ] ), q, level ).x ) );
+	return depth < hiz;
+}
+
+void main()
+{
+	const uint index = gl_GlobalInvocationID.x;
+	if ( index >= instance_count )
+	{
+		return;
+	}
+
+	const bool was_visible = state.words[ VISIBILITY + index ] != 0;
+	if ( pass == 0 && !was_visible )
+	{
+		return;
+	}
+
+	const Instance instance = instances[ index ];
+	const vec3 center = ( view * vec4( instance.bounding_sphere.xyz, 1.0 ) ).xyz;
+	const float radius = instance.bounding_sphere.w;
+	const float z_near = projection.z;
+	const float z_far = projection.w;
+
+	// Side planes go through the origin, normals only depend on the projection
+	const vec2 frustum_x = normalize( vec2( projection.x, 1.0 ) );
+	const vec2 frustum_y = normalize( vec2( projection.y, 1.0 ) );
+	bool visible = instance.count > 0;
+	visible = visible && center.z * frustum_x.y - abs( center.x ) * frustum_x.x > -radius;
+	visible = visible && center.z * frustum_y.y - abs( center.y ) * frustum_y.x > -radius;
+	visible = visible && center.z + radius > z_near && ( z_far == 0.0 || center.z - radius < z_far );
+
+	// Bounds crossing the near plane can't be projected, they are kept
+	if ( visible && center.z - radius > z_near )
+	{
+		const vec4 aabb = project_sphere( center, radius );
+		if ( small_primitive_culling != 0 )
+		{
+			// Nothing is rasterized when no pixel center is covered (without MSAA)
+			const vec4 pixels = round( aabb * viewport.xyxy );
+			visible = pixels.x != pixels.z && pixels.y != pixels.w;
+		}
+		if ( visible && pass == 1 && hiz_index != ~0u )
+		{
+			visible = !is_occluded( aabb, z_near / ( center.z - radius ) );
+		}
+	}
+
+	if ( pass == 1 )
+	{
+		state.words[ VISIBILITY + index ] = visible ? 1u : 0u;
+		// Already drawn by the early pass
+		visible = visible && !was_visible;
+	}
+	if ( !visible )
+	{
+		return;
+	}
+
+	const uint slot = atomicAdd( state.words[ pass ], 1u );
+	state.words[ VISIBILITY + max_instances * ( 1 + pass ) + slot ] = index;
+	const uint command = VISIBILITY + max_instances * 3 + ( pass * max_instances + slot ) * COMMAND_WORDS;
+#if MESH_TASKS
+	state.words[ command ] = instance.count;
+	state.words[ command + 1 ] = 1;
+	state.words[ command + 2 ] = 1;
+#else
+	state.words[ command ] = instance.count;
+	state.words[ command + 1 ] = 1;
+	state.words[ command + 2 ] = instance.first_index;
+	state.words[ command + 3 ] = uint( instance.vertex_offset );
+	state.words[ command + 4 ] = index;
+#endif
+}
+)";
+
+	renderer::AccessInfo merge_access( std::initializer_list<renderer::Access> accesses )
+	{
+		renderer::AccessInfo info {};
+		for ( auto access : accesses )
+		{
+			const auto next = renderer::get_access_info( access );
+			info.stages |= next.stages;
+			info.access |= next.access;
+		}
+		return info;
+	}
+}
+
+renderer::GpuCuller::GpuCuller( Device& device, const BindlessManagerBase& bindless_manager, const Desc& desc )
+	: _device( &device )
+	, _bindless_manager( &bindless_manager )
+	, _desc( desc )
+	, _compiler( std::filesystem::path {} )
+{
+	if ( desc.output == Output::MESH_TASKS && !device.get_properties().mesh_shader_support )
+	{
+		throw Error( "GPU culling to mesh tasks needs mesh shader support" );
+	}
+
+	OPTICK_EVENT();
+	ShaderSource source { .path = "gpu_culler.comp",
+						  .stage = ShaderStage::COMPUTE,
+						  .defines = { { "INSTANCE_BINDING", std::to_string( desc.instance_binding ) },
+									   { "MESH_TASKS", desc.output == Output::MESH_TASKS ? "1" : "0" } } };
+	auto code = _compiler.compile( std::move( source ), CULL_SHADER );
+	if ( !code )
+	{
+		throw Error( code.error() );
+	}
+	const Pipeline::Desc pipeline_desc { .push_constants_size = sizeof( PushConstants ) };
+	_pipeline = device.create_compute_pipeline( pipeline_desc, *code, bindless_manager );
+
+	const std::size_t words = HEADER_WORDS + std::size_t( desc.max_instances ) * ( 3 + 2 * get_command_size() / sizeof( uint32_t ) );
+	_buffer = device.create_buffer( Buffer::Usage::STORAGE_BUFFER | Buffer::Usage::INDIRECT_BUFFER | Buffer::Usage::SHADER_DEVICE_ADDRESS
+										| Buffer::Usage::TRANSFER_DST,
+									words * sizeof( uint32_t ) );
+}
+
+void renderer::GpuCuller::cull( CommandBuffer& cmd, Pass pass, const View& view, uint32_t instance_count, const BindlessTexture* hiz )
+{
+	OPTICK_EVENT();
+	if ( instance_count > _desc.max_instances )
+	{
+		throw Error( "Too many instances to cull" );
+	}
+
+	// Previous passes or frames may still be reading draws and visible instances
+	const auto shader_read = _desc.output == Output::MESH_TASKS ? Access::TASK_MESH_SHADER_READ : Access::ANY_SHADER_READ;
+	const auto previous = merge_access( { Access::INDIRECT_READ, shader_read, Access::COMPUTE_STORAGE_READ_WRITE } );
+	cmd.barrier( _buffer, previous, merge_access( { Access::TRANSFER_WRITE, Access::COMPUTE_STORAGE_READ_WRITE } ) );
+	if ( !_visibility_cleared )
+	{
+		cmd.fill_buffer( _buffer, 0, _buffer.get_size(), 0 );
+		_visibility_cleared = true;
+	}
+	else
+	{
+		cmd.fill_buffer( _buffer, get_count_offset( pass ), sizeof( uint32_t ), 0 );
+	}
+	cmd.barrier( _buffer, Access::TRANSFER_WRITE, Access::COMPUTE_STORAGE_READ_WRITE );
+
+	const bool occlusion = pass == Pass::LATE && hiz;
+	if ( occlusion )
+	{
+		cmd.use_texture( hiz->texture, Access::COMPUTE_SHADER_READ );
+	}
+
+	const PushConstants constants { .view = view.view,
+									.projection = { view.p00, view.p11, view.z_near, view.z_far },
+									.viewport = { static_cast<float>( view.viewport.width ), static_cast<float>( view.viewport.height ) },
+									.small_primitive_culling = view.small_primitive_culling ? 1u : 0u,
+									.hiz_index = occlusion ? hiz->handles.texture_index : NO_HIZ,
+									.state = _buffer.get_device_address(),
+									.instance_count = instance_count,
+									.max_instances = _desc.max_instances,
+									.pass = static_cast<uint32_t>( std::to_underlying( pass ) ),
+									.padding = 0 };
+	cmd.bind_pipeline( _pipeline, *_bindless_manager );
+	cmd.push_constants( _pipeline, constants );
+	cmd.dispatch( ( instance_count + GROUP_SIZE - 1 ) / GROUP_SIZE, 1, 1 );
+
+	cmd.barrier( _buffer, get_access_info( Access::COMPUTE_STORAGE_READ_WRITE ), merge_access( { Access::INDIRECT_READ, shader_read } ) );
+}
+
+void renderer::GpuCuller::draw( CommandBuffer& cmd, Pass pass ) const
+{
+	if ( _desc.output == Output::MESH_TASKS )
+	{
+		cmd.draw_mesh_tasks_indirect( _buffer,
+									  get_commands_offset( pass ),
+									  _buffer,
+									  get_count_offset( pass ),
+									  _desc.max_instances,
+									  get_command_size() );
+	}
+	else
+	{
+		cmd.draw_indexed_indirect( _buffer,
+								   get_commands_offset( pass ),
+								   _buffer,
+								   get_count_offset( pass ),
+								   _desc.max_instances,
+								   get_command_size() );
+	}
+}
+
+vk::DeviceAddress renderer::GpuCuller::get_visible_instances( Pass pass ) const
+{
+	const std::size_t word = HEADER_WORDS + std::size_t( _desc.max_instances ) * ( 1 + std::to_underlying( pass ) );
+	return _buffer.get_device_address() + word * sizeof( uint32_t );
+}
+
+std::size_t renderer::GpuCuller::get_commands_offset( Pass pass ) const
+{
+	const std::size_t word = HEADER_WORDS + std::size_t( _desc.max_instances ) * 3;
+	return word * sizeof( uint32_t ) + std::size_t( _desc.max_instances ) * std::to_underlying( pass ) * get_command_size();
+}
+
+uint32_t renderer::GpuCuller::get_command_size() const
+{
+	return ( _desc.output == Output::MESH_TASKS ? MESH_TASKS_WORDS : DRAW_INDEXED_WORDS ) * sizeof( uint32_t );
+}
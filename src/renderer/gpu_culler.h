@@ -0,0 +1,115 @@
+#pragma once
+
+#include <renderer/bindless.h>
+#include <renderer/buffer.h>
+#include <renderer/command_buffer.h>
+#include <renderer/common.h>
+#include <renderer/pipeline.h>
+#include <renderer/shader_compiler.h>
+
+namespace renderer
+{
+	class Device;
+
+	// Culls instances on the GPU and writes compacted indirect draws, for draw_indexed_indirect() or
+	// draw_mesh_tasks_indirect() with a count buffer.
+	// Instances are read from a bindless buffer of GpuCuller::Instance (see BindlessManager::get_buffer_binding()). Tests
+	// are frustum, small primitives (bounds not covering any pixel center) and occlusion against a Hi-Z pyramid.
+	//
+	// Occlusion is two pass, each frame:
+	// - cull( EARLY ): instances visible last frame, without occlusion, then draw( EARLY )
+	// - build the Hi-Z pyramid from that depth (min reduction, see HiZBuilder)
+	// - cull( LATE ): all instances, with occlusion, which updates visibility for the next frame. Only instances that
+	//   weren't drawn by the early pass are kept, then draw( LATE ) on top of the same depth.
+	// Shaders find the instance of a draw in get_visible_instances() at gl_DrawID. Indexed draws also set firstInstance
+	// to the instance index.
+	class GpuCuller
+	{
+	public:
+		// Matches the GLSL std430 layout
+		struct Instance
+		{
+			std::array<float, 4> bounding_sphere; // World space center and radius
+			uint32_t count;						  // Index count, or task workgroups for mesh tasks
+			uint32_t first_index;
+			int32_t vertex_offset;
+			uint32_t padding = 0;
+		};
+
+		// View space looks down +Z with a symmetric reverse Z perspective projection (depth = z_near / z)
+		struct View
+		{
+			std::array<float, 16> view; // World to view, column major, without scale
+			float p00;					// projection[ 0 ][ 0 ]
+			float p11;					// projection[ 1 ][ 1 ]
+			float z_near;
+			float z_far = 0.f; // 0 for infinite
+			Extent2D viewport;
+			bool small_primitive_culling = true;
+		};
+
+		enum class Output
+		{
+			DRAW_INDEXED,
+			MESH_TASKS
+		};
+
+		enum class Pass
+		{
+			EARLY,
+			LATE
+		};
+
+		struct Desc
+		{
+			uint32_t max_instances = 128 * 1024;
+			Output output = Output::DRAW_INDEXED;
+			// Binding of the GpuCuller::Instance buffer in the bindless buffers set
+			uint32_t instance_binding = 0;
+		};
+
+		GpuCuller( Device& device, const BindlessManagerBase& bindless_manager, const Desc& desc );
+
+		// Must be called outside of rendering. Hi-Z is ignored by the early pass, without it the late pass keeps every
+		// instance that passes other tests.
+		void cull( CommandBuffer& cmd, Pass pass, const View& view, uint32_t instance_count, const BindlessTexture* hiz = nullptr );
+		// Binds nothing, the pipeline and index buffer must already be bound
+		void draw( CommandBuffer& cmd, Pass pass ) const;
+
+		// Forgets last frame's visibility, eg: after a camera cut
+		void reset_visibility() { _visibility_cleared = false; }
+
+		// Needs a device address, indexed by gl_DrawID
+		Buffer get_buffer() const { return _buffer; }
+		vk::DeviceAddress get_visible_instances( Pass pass ) const;
+
+	private:
+		struct PushConstants
+		{
+			std::array<float, 16> view;
+			std::array<float, 4> projection;
+			std::array<float, 2> viewport;
+			uint32_t small_primitive_culling;
+			uint32_t hiz_index;
+			vk::DeviceAddress state;
+			uint32_t instance_count;
+			uint32_t max_instances;
+			uint32_t pass;
+			uint32_t padding;
+		};
+		static_assert( sizeof( PushConstants ) <= 128 );
+
+		std::size_t get_commands_offset( Pass pass ) const;
+		std::size_t get_count_offset( Pass pass ) const { return std::to_underlying( pass ) * sizeof( uint32_t ); }
+		uint32_t get_command_size() const;
+
+		Device* _device;
+		const BindlessManagerBase* _bindless_manager;
+		Desc _desc;
+		ShaderCompiler _compiler;
+		raii::Pipeline _pipeline;
+		// Counts, visibility, visible instances of each pass and commands of each pass
+		raii::Buffer _buffer;
+		bool _visibility_cleared = false;
+	};
+}
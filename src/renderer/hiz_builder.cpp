@@ -0,0 +1,49 @@
+#include "hiz_builder.h"
+
+#include <algorithm>
+#include <bit>
+#include <renderer/details/profiler.h>
+#include <renderer/device.h>
+
+renderer::HiZBuilder::HiZBuilder( Device& device, BindlessManagerBase& bindless_manager, const Desc& desc )
+	: _device( &device )
+	, _bindless_manager( &bindless_manager )
+	, _desc( desc )
+	, _mip_generator( device, bindless_manager )
+{
+}
+
+void renderer::HiZBuilder::build( CommandBuffer& cmd, const BindlessTexture& depth )
+{
+	OPTICK_EVENT();
+	if ( depth.texture.get_extent() != _depth_extent )
+	{
+		create_pyramid( depth.texture.get_extent() );
+	}
+
+	const auto reduction = _desc.reverse_z ? MipGenerator::Reduction::MIN : MipGenerator::Reduction::MAX;
+	_mip_generator.downsample( cmd, depth, _pyramid, reduction );
+}
+
+void renderer::HiZBuilder::create_pyramid( Extent2D depth_extent )
+{
+	OPTICK_EVENT();
+	if ( !_pyramid.mips.empty() )
+	{
+		_bindless_manager->remove_texture( _pyramid );
+	}
+
+	// Previous power of two so that every level is exactly half the previous one and its 2x2 reductions cover all of
+	// it. Mip 0 reduces the up to 3x3 depth texels each of its texels covers (see MipGenerator::downsample()).
+	const auto pyramid_extent = []( uint32_t depth )
+	{ return std::min( std::bit_floor( std::max( depth, 1u ) ), MipGenerator::MAX_DESTINATION_EXTENT ); };
+	const Extent2D extent { .width = pyramid_extent( depth_extent.width ), .height = pyramid_extent( depth_extent.height ) };
+	const int mips = std::min( static_cast<int>( std::bit_width( std::max( extent.width, extent.height ) ) ),
+							   MipGenerator::MAX_LEVELS );
+	auto texture = _device->create_texture( { .format = Texture::Format::R32_SFLOAT,
+											  .usage = Texture::Usage::SAMPLED | Texture::Usage::STORAGE,
+											  .extent = extent,
+											  .mips = mips } );
+	_pyramid = _bindless_manager->add_texture( std::move( texture ), true );
+	_depth_extent = depth_extent;
+}
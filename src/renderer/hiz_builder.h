@@ -0,0 +1,45 @@
+#pragma once
+
+#include <renderer/bindless.h>
+#include <renderer/command_buffer.h>
+#include <renderer/common.h>
+#include <renderer/mip_generator.h>
+
+namespace renderer
+{
+	class Device;
+
+	// Builds a hierarchical depth pyramid (Hi-Z) for occlusion culling and screen space effects. Each texel of the
+	// R32_SFLOAT pyramid holds the farthest depth it covers: the min with reverse Z, the max otherwise.
+	// All mips are built in a single dispatch (see MipGenerator::downsample()), the first level reads depth through the
+	// min/max reduction samplers when the device supports them, with up to 4 fetches per texel.
+	class HiZBuilder
+	{
+	public:
+		struct Desc
+		{
+			bool reverse_z = true;
+		};
+
+		HiZBuilder( Device& device, BindlessManagerBase& bindless_manager, const Desc& desc = {} );
+
+		// Depth must be a bindless texture with SAMPLED usage (D32_SFLOAT or R32_SFLOAT), up to 4096x4096.
+		// The pyramid is created on first use and recreated when the depth extent changes. It's left in compute storage
+		// state, readers declare their access with CommandBuffer::use_texture().
+		void build( CommandBuffer& cmd, const BindlessTexture& depth );
+
+		// Mip 0 is the previous power of two of the depth extent, up to 2048x2048, each texel covering the same fraction
+		// of the screen at a given level. Empty until the first build().
+		const BindlessTexture& get_pyramid() const { return _pyramid; }
+
+	private:
+		void create_pyramid( Extent2D depth_extent );
+
+		Device* _device;
+		BindlessManagerBase* _bindless_manager;
+		Desc _desc;
+		MipGenerator _mip_generator;
+		BindlessTexture _pyramid;
+		Extent2D _depth_extent;
+	};
+}
@@ -0,0 +1,140 @@
+#include "ktx.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <renderer/details/profiler.h>
+#include <renderer/device.h>
+#include <renderer/upload_manager.h>
+
+namespace
+{
+	constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	// Everything is little endian, like the platforms we run on
+	struct Header
+	{
+		std::array<uint8_t, 12> identifier;
+		uint32_t vk_format;
+		uint32_t type_size;
+		uint32_t pixel_width;
+		uint32_t pixel_height;
+		uint32_t pixel_depth;
+		uint32_t layer_count;
+		uint32_t face_count;
+		uint32_t level_count;
+		uint32_t supercompression_scheme;
+		uint32_t dfd_byte_offset;
+		uint32_t dfd_byte_length;
+		uint32_t kvd_byte_offset;
+		uint32_t kvd_byte_length;
+		uint64_t sgd_byte_offset;
+		uint64_t sgd_byte_length;
+	};
+	static_assert( sizeof( Header ) == 80 );
+
+	struct LevelIndex
+	{
+		uint64_t byte_offset;
+		uint64_t byte_length;
+		uint64_t uncompressed_byte_length;
+	};
+	static_assert( sizeof( LevelIndex ) == 24 );
+}
+
+renderer::Ktx2Image renderer::parse_ktx2( std::span<const std::byte> data )
+{
+	Header header;
+	if ( data.size() < sizeof( Header ) )
+	{
+		throw Error( "Not a KTX2 file" );
+	}
+	std::memcpy( &header, data.data(), sizeof( Header ) );
+	if ( header.identifier != KTX2_IDENTIFIER )
+	{
+		throw Error( "Not a KTX2 file" );
+	}
+	if ( header.supercompression_scheme != 0 )
+	{
+		throw Error( "Supercompressed KTX2 files are not supported" );
+	}
+	if ( header.pixel_width == 0 || header.pixel_height == 0 || ( header.face_count != 1 && header.face_count != 6 )
+		 || ( header.pixel_depth > 0 && ( header.face_count != 1 || header.layer_count > 0 ) ) )
+	{
+		throw Error( "Unsupported KTX2 texture type, only 2D, cube and 3D textures are" );
+	}
+
+	const auto format = static_cast<Texture::Format>( header.vk_format );
+	if ( Texture::get_block_info( format ).size == 0 )
+	{
+		throw Error( std::format( "Unsupported KTX2 texture format {}", header.vk_format ) );
+	}
+
+	// A level count of 0 asks the loader to generate mips, which we leave to the caller
+	const uint32_t level_count = std::max( header.level_count, 1u );
+	const auto max_extent = std::max( { header.pixel_width, header.pixel_height, header.pixel_depth } );
+	if ( level_count > static_cast<uint32_t>( std::bit_width( max_extent ) ) )
+	{
+		throw Error( "KTX2 file has more levels than its extent allows" );
+	}
+	if ( data.size() < sizeof( Header ) + level_count * sizeof( LevelIndex ) )
+	{
+		throw Error( "Truncated KTX2 file" );
+	}
+
+	// Levels hold layers, then faces, then depth slices, which is how Vulkan expects cube faces in array layers
+	const auto type = header.face_count == 6 ? Texture::Type::CUBE
+		: header.pixel_depth > 0			 ? Texture::Type::TEXTURE_3D
+											 : Texture::Type::TEXTURE_2D;
+	Ktx2Image image { .desc = { .format = format,
+								.extent = { .width = header.pixel_width, .height = header.pixel_height },
+								.mips = static_cast<int>( level_count ),
+								.type = type,
+								.layers = static_cast<int>( std::max( header.layer_count, 1u ) * header.face_count ),
+								.depth = static_cast<int>( std::max( header.pixel_depth, 1u ) ) } };
+	image.mips.reserve( level_count );
+	for ( uint32_t level = 0; level < level_count; ++level )
+	{
+		LevelIndex index;
+		std::memcpy( &index, data.data() + sizeof( Header ) + level * sizeof( LevelIndex ), sizeof( LevelIndex ) );
+		if ( index.byte_offset > data.size() || index.byte_length > data.size() - index.byte_offset )
+		{
+			throw Error( "Truncated KTX2 file" );
+		}
+		if ( index.byte_length != Texture::get_mip_size( image.desc, level ) )
+		{
+			throw Error( "KTX2 level size doesn't match its format and extent" );
+		}
+		image.mips.push_back( data.subspan( index.byte_offset, index.byte_length ) );
+	}
+	return image;
+}
+
+renderer::raii::Texture renderer::load_ktx2( Device& device, UploadManager& uploader, std::span<const std::byte> data, Texture::Usage usage )
+{
+	OPTICK_EVENT();
+	auto image = parse_ktx2( data );
+	if ( !device.is_format_supported( image.desc.format ) )
+	{
+		throw Error( "KTX2 texture format not supported by the device" );
+	}
+
+	image.desc.usage = usage | Texture::Usage::TRANSFER_DST;
+	auto texture = device.create_texture( image.desc );
+	uploader.upload( texture, 0, image.mips );
+	return texture;
+}
+
+renderer::raii::Texture
+renderer::load_ktx2( Device& device, UploadManager& uploader, const std::filesystem::path& path, Texture::Usage usage )
+{
+	std::ifstream istream( path, std::ios::binary );
+	if ( !istream )
+	{
+		throw Error( std::format( "Couldn't open texture file '{}'", path.string() ) );
+	}
+	const std::vector<char> content { std::istreambuf_iterator<char>( istream ), std::istreambuf_iterator<char>() };
+	return load_ktx2( device, uploader, std::as_bytes( std::span( content ) ), usage );
+}
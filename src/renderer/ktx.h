@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <renderer/common.h>
+#include <renderer/texture.h>
+
+namespace renderer
+{
+	class Device;
+	class UploadManager;
+
+	// Contents of a KTX2 container, see https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+	// 2D and cube textures (and arrays of them) and 3D textures are supported, without supercompression.
+	struct Ktx2Image
+	{
+		Texture::Desc desc;
+		// Point into the parsed data, from the biggest to the smallest
+		std::vector<std::span<const std::byte>> mips;
+	};
+
+	// Throws renderer::Error if the data isn't a valid or supported KTX2 file
+	Ktx2Image parse_ktx2( std::span<const std::byte> data );
+
+	// Creates the texture and queues all its mips for upload, straight from the file data.
+	// Data is copied right away and can be released on return. Call UploadManager::flush() before using the texture.
+	// TRANSFER_DST is always added to the usage.
+	raii::Texture load_ktx2( Device& device,
+							 UploadManager& uploader,
+							 std::span<const std::byte> data,
+							 Texture::Usage usage = Texture::Usage::SAMPLED );
+	raii::Texture load_ktx2( Device& device,
+							 UploadManager& uploader,
+							 const std::filesystem::path& path,
+							 Texture::Usage usage = Texture::Usage::SAMPLED );
+}
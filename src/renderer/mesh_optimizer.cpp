@@ -0,0 +1,381 @@
+#include "mesh_optimizer.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <renderer/details/profiler.h>
+
+namespace
+{
+	constexpr uint32_t NOT_FOUND = std::numeric_limits<uint32_t>::max();
+
+	// Forsyth's scoring, tuned for a 32 entries LRU cache which makes the order good for any real hardware cache
+	constexpr uint32_t CACHE_SIZE = 32;
+	constexpr float CACHE_DECAY_POWER = 1.5f;
+	constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+	constexpr float VALENCE_BOOST_SCALE = 2.f;
+	constexpr float VALENCE_BOOST_POWER = 0.5f;
+	constexpr uint32_t MAX_VALENCE_SCORE = 32;
+
+	// FIFO cache size for the overdraw clusters, close to what GPUs actually have
+	constexpr uint32_t FIFO_CACHE_SIZE = 16;
+
+	using Vec3 = std::array<float, 3>;
+
+	Vec3 operator-( const Vec3& a, const Vec3& b ) { return { a[ 0 ] - b[ 0 ], a[ 1 ] - b[ 1 ], a[ 2 ] - b[ 2 ] }; }
+	float dot( const Vec3& a, const Vec3& b ) { return a[ 0 ] * b[ 0 ] + a[ 1 ] * b[ 1 ] + a[ 2 ] * b[ 2 ]; }
+	Vec3 cross( const Vec3& a, const Vec3& b )
+	{
+		return { a[ 1 ] * b[ 2 ] - a[ 2 ] * b[ 1 ], a[ 2 ] * b[ 0 ] - a[ 0 ] * b[ 2 ], a[ 0 ] * b[ 1 ] - a[ 1 ] * b[ 0 ] };
+	}
+
+	void validate( std::span<const uint32_t> indices, std::size_t vertex_count )
+	{
+		if ( indices.size() % 3 != 0 )
+		{
+			throw renderer::Error( "Mesh optimization needs a triangle list" );
+		}
+		if ( std::ranges::any_of( indices, [ & ]( uint32_t index ) { return index >= vertex_count; } ) )
+		{
+			throw renderer::Error( "Mesh index out of the vertex range" );
+		}
+	}
+
+	struct ScoreTables
+	{
+		std::array<float, CACHE_SIZE> cache;
+		std::array<float, MAX_VALENCE_SCORE + 1> valence;
+	};
+
+	const ScoreTables& get_score_tables()
+	{
+		static const ScoreTables tables = []
+		{
+			ScoreTables result;
+			for ( uint32_t position = 0; position < CACHE_SIZE; ++position )
+			{
+				// The 3 most recent vertices get a fixed score, so that strips don't always win over fans
+				result.cache[ position ] = position < 3
+					? LAST_TRIANGLE_SCORE
+					: std::pow( 1.f - float( position - 3 ) / float( CACHE_SIZE - 3 ), CACHE_DECAY_POWER );
+			}
+			result.valence[ 0 ] = 0.f;
+			for ( uint32_t valence = 1; valence <= MAX_VALENCE_SCORE; ++valence )
+			{
+				// Vertices with few triangles left are worth finishing
+				result.valence[ valence ] = VALENCE_BOOST_SCALE * std::pow( float( valence ), -VALENCE_BOOST_POWER );
+			}
+			return result;
+		}();
+		return tables;
+	}
+
+	float get_vertex_score( const ScoreTables& tables, uint32_t cache_position, uint32_t remaining )
+	{
+		if ( remaining == 0 )
+		{
+			return -1.f;
+		}
+		const float cache_score = cache_position < CACHE_SIZE ? tables.cache[ cache_position ] : 0.f;
+		return cache_score + tables.valence[ std::min( remaining, MAX_VALENCE_SCORE ) ];
+	}
+
+	// Misses of the triangle in a FIFO cache, a vertex is still cached if less than FIFO_CACHE_SIZE misses happened
+	// since it was loaded
+	uint32_t simulate_fifo( const uint32_t* triangle, std::vector<uint32_t>& timestamps, uint32_t& timestamp )
+	{
+		uint32_t misses = 0;
+		for ( uint32_t i = 0; i < 3; ++i )
+		{
+			if ( timestamp - timestamps[ triangle[ i ] ] > FIFO_CACHE_SIZE )
+			{
+				timestamps[ triangle[ i ] ] = timestamp++;
+				++misses;
+			}
+		}
+		return misses;
+	}
+}
+
+void renderer::optimize_vertex_cache( std::span<uint32_t> indices, std::size_t vertex_count )
+{
+	OPTICK_EVENT();
+	validate( indices, vertex_count );
+	const auto triangle_count = static_cast<uint32_t>( indices.size() / 3 );
+	if ( triangle_count == 0 )
+	{
+		return;
+	}
+	const auto& tables = get_score_tables();
+
+	// Triangles not emitted yet around each vertex, the first remaining[ vertex ] of its range
+	std::vector<uint32_t> offsets( vertex_count + 1, 0 );
+	for ( const auto index : indices )
+	{
+		++offsets[ index + 1 ];
+	}
+	for ( std::size_t vertex = 0; vertex < vertex_count; ++vertex )
+	{
+		offsets[ vertex + 1 ] += offsets[ vertex ];
+	}
+	std::vector<uint32_t> remaining( vertex_count, 0 );
+	std::vector<uint32_t> adjacency( indices.size() );
+	for ( uint32_t i = 0; i < indices.size(); ++i )
+	{
+		const auto vertex = indices[ i ];
+		adjacency[ offsets[ vertex ] + remaining[ vertex ]++ ] = i / 3;
+	}
+
+	std::vector<uint32_t> cache_positions( vertex_count, CACHE_SIZE );
+	std::vector<float> vertex_scores( vertex_count );
+	for ( std::size_t vertex = 0; vertex < vertex_count; ++vertex )
+	{
+		vertex_scores[ vertex ] = get_vertex_score( tables, CACHE_SIZE, remaining[ vertex ] );
+	}
+	const auto get_triangle_score = [ & ]( uint32_t triangle )
+	{
+		const auto* vertices = &indices[ triangle * 3 ];
+		return vertex_scores[ vertices[ 0 ] ] + vertex_scores[ vertices[ 1 ] ] + vertex_scores[ vertices[ 2 ] ];
+	};
+	uint32_t best = 0;
+	float best_score = get_triangle_score( 0 );
+	for ( uint32_t triangle = 1; triangle < triangle_count; ++triangle )
+	{
+		if ( const float score = get_triangle_score( triangle ); score > best_score )
+		{
+			best = triangle;
+			best_score = score;
+		}
+	}
+
+	std::vector<uint8_t> emitted( triangle_count, 0 );
+	std::vector<uint32_t> result;
+	result.reserve( indices.size() );
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> next_cache;
+	cache.reserve( CACHE_SIZE + 3 );
+	next_cache.reserve( CACHE_SIZE + 3 );
+	uint32_t cursor = 0;
+	while ( best != NOT_FOUND )
+	{
+		emitted[ best ] = 1;
+		const std::array<uint32_t, 3> triangle = { indices[ best * 3 ], indices[ best * 3 + 1 ], indices[ best * 3 + 2 ] };
+		result.insert( end( result ), begin( triangle ), end( triangle ) );
+
+		// Most recent first, what falls off the end is evicted
+		next_cache.clear();
+		for ( const auto vertex : triangle )
+		{
+			const auto first = begin( adjacency ) + offsets[ vertex ];
+			std::iter_swap( std::find( first, first + remaining[ vertex ], best ), first + remaining[ vertex ] - 1 );
+			--remaining[ vertex ];
+			if ( std::ranges::find( next_cache, vertex ) == end( next_cache ) )
+			{
+				next_cache.push_back( vertex );
+			}
+		}
+		for ( const auto vertex : cache )
+		{
+			if ( std::ranges::find( triangle, vertex ) == end( triangle ) )
+			{
+				next_cache.push_back( vertex );
+			}
+		}
+		std::swap( cache, next_cache );
+
+		for ( uint32_t position = 0; position < cache.size(); ++position )
+		{
+			const auto vertex = cache[ position ];
+			cache_positions[ vertex ] = std::min( position, CACHE_SIZE );
+			vertex_scores[ vertex ] = get_vertex_score( tables, cache_positions[ vertex ], remaining[ vertex ] );
+		}
+
+		// Only scores of triangles around cached (or just evicted) vertices changed, the best next one is among them
+		best = NOT_FOUND;
+		best_score = -1.f;
+		for ( const auto vertex : cache )
+		{
+			for ( uint32_t i = 0; i < remaining[ vertex ]; ++i )
+			{
+				const auto candidate = adjacency[ offsets[ vertex ] + i ];
+				if ( const float score = get_triangle_score( candidate ); score > best_score )
+				{
+					best = candidate;
+					best_score = score;
+				}
+			}
+		}
+		cache.resize( std::min<std::size_t>( cache.size(), CACHE_SIZE ) );
+
+		if ( best == NOT_FOUND )
+		{
+			// Nothing left around the cache, carry on with the next triangle in the original order
+			while ( cursor < triangle_count && emitted[ cursor ] )
+			{
+				++cursor;
+			}
+			best = cursor < triangle_count ? cursor : NOT_FOUND;
+		}
+	}
+	std::ranges::copy( result, begin( indices ) );
+}
+
+void renderer::optimize_overdraw( std::span<uint32_t> indices, std::span<const std::array<float, 3>> positions, float threshold )
+{
+	OPTICK_EVENT();
+	validate( indices, positions.size() );
+	const auto triangle_count = static_cast<uint32_t>( indices.size() / 3 );
+	if ( triangle_count == 0 )
+	{
+		return;
+	}
+
+	// Hard boundaries are where the cache is fully flushed, clusters can move around without extra misses
+	std::vector<uint32_t> timestamps( positions.size(), 0 );
+	uint32_t timestamp = FIFO_CACHE_SIZE + 1;
+	std::vector<uint32_t> hard_clusters;
+	std::vector<uint32_t> misses( triangle_count );
+	for ( uint32_t triangle = 0; triangle < triangle_count; ++triangle )
+	{
+		misses[ triangle ] = simulate_fifo( &indices[ triangle * 3 ], timestamps, timestamp );
+		if ( triangle == 0 || misses[ triangle ] == 3 )
+		{
+			hard_clusters.push_back( triangle );
+		}
+	}
+	hard_clusters.push_back( triangle_count );
+
+	// Soft boundaries split them further, as long as each part stays within threshold of the cluster's misses per
+	// triangle when starting from an empty cache
+	std::vector<uint32_t> clusters;
+	for ( std::size_t hard = 0; hard + 1 < hard_clusters.size(); ++hard )
+	{
+		const auto first = hard_clusters[ hard ];
+		const auto last = hard_clusters[ hard + 1 ];
+		uint32_t cluster_misses = 0;
+		for ( auto triangle = first; triangle < last; ++triangle )
+		{
+			cluster_misses += misses[ triangle ];
+		}
+		const float max_ratio = threshold * float( cluster_misses ) / float( last - first );
+
+		clusters.push_back( first );
+		timestamp += FIFO_CACHE_SIZE + 1;
+		uint32_t start = first;
+		uint32_t start_misses = 0;
+		for ( auto triangle = first; triangle < last; ++triangle )
+		{
+			start_misses += simulate_fifo( &indices[ triangle * 3 ], timestamps, timestamp );
+			if ( triangle + 1 < last && float( start_misses ) <= max_ratio * float( triangle + 1 - start ) )
+			{
+				clusters.push_back( triangle + 1 );
+				timestamp += FIFO_CACHE_SIZE + 1;
+				start = triangle + 1;
+				start_misses = 0;
+			}
+		}
+	}
+	clusters.push_back( triangle_count );
+
+	// Clusters facing away from the mesh center go first, they are the likely occluders
+	Vec3 mesh_center = { 0.f, 0.f, 0.f };
+	for ( const auto index : indices )
+	{
+		for ( int i = 0; i < 3; ++i )
+		{
+			mesh_center[ i ] += positions[ index ][ i ] / float( indices.size() );
+		}
+	}
+	const auto cluster_count = clusters.size() - 1;
+	std::vector<float> sort_keys( cluster_count, 0.f );
+	for ( std::size_t cluster = 0; cluster < cluster_count; ++cluster )
+	{
+		Vec3 normal = { 0.f, 0.f, 0.f };
+		Vec3 center = { 0.f, 0.f, 0.f };
+		float area = 0.f;
+		for ( auto triangle = clusters[ cluster ]; triangle < clusters[ cluster + 1 ]; ++triangle )
+		{
+			const auto& a = positions[ indices[ triangle * 3 ] ];
+			const auto& b = positions[ indices[ triangle * 3 + 1 ] ];
+			const auto& c = positions[ indices[ triangle * 3 + 2 ] ];
+			const auto triangle_normal = cross( b - a, c - a );
+			const float triangle_area = std::sqrt( dot( triangle_normal, triangle_normal ) );
+			for ( int i = 0; i < 3; ++i )
+			{
+				normal[ i ] += triangle_normal[ i ];
+				center[ i ] += ( a[ i ] + b[ i ] + c[ i ] ) * triangle_area / 3.f;
+			}
+			area += triangle_area;
+		}
+		const float normal_length = std::sqrt( dot( normal, normal ) );
+		if ( area > 0.f && normal_length > 0.f )
+		{
+			for ( int i = 0; i < 3; ++i )
+			{
+				center[ i ] /= area;
+			}
+			sort_keys[ cluster ] = dot( center - mesh_center, normal ) / normal_length;
+		}
+	}
+
+	std::vector<uint32_t> order( cluster_count );
+	for ( uint32_t cluster = 0; cluster < cluster_count; ++cluster )
+	{
+		order[ cluster ] = cluster;
+	}
+	std::ranges::stable_sort( order, [ & ]( uint32_t lhs, uint32_t rhs ) { return sort_keys[ lhs ] > sort_keys[ rhs ]; } );
+
+	std::vector<uint32_t> result;
+	result.reserve( indices.size() );
+	for ( const auto cluster : order )
+	{
+		result.insert( end( result ), begin( indices ) + clusters[ cluster ] * 3, begin( indices ) + clusters[ cluster + 1 ] * 3 );
+	}
+	std::ranges::copy( result, begin( indices ) );
+}
+
+std::vector<uint32_t> renderer::optimize_vertex_fetch( std::span<uint32_t> indices, std::size_t vertex_count )
+{
+	OPTICK_EVENT();
+	validate( indices, vertex_count );
+	std::vector<uint32_t> remap( vertex_count, UNUSED_VERTEX );
+	uint32_t next = 0;
+	for ( auto& index : indices )
+	{
+		if ( remap[ index ] == UNUSED_VERTEX )
+		{
+			remap[ index ] = next++;
+		}
+		index = remap[ index ];
+	}
+	return remap;
+}
+
+renderer::Buffer::IndexType renderer::get_index_type( std::size_t vertex_count, bool uint8_support )
+{
+	// Primitive restart isn't used, the max value of each type is a valid index
+	if ( uint8_support && vertex_count <= std::numeric_limits<uint8_t>::max() + 1zu )
+	{
+		return Buffer::IndexType::UINT8;
+	}
+	if ( vertex_count <= std::numeric_limits<uint16_t>::max() + 1zu )
+	{
+		return Buffer::IndexType::UINT16;
+	}
+	return Buffer::IndexType::UINT32;
+}
+
+renderer::NarrowedIndices renderer::narrow_indices( std::span<const uint32_t> indices, std::size_t vertex_count, bool uint8_support )
+{
+	OPTICK_EVENT();
+	validate( indices, vertex_count );
+	NarrowedIndices narrowed { .type = get_index_type( vertex_count, uint8_support ), .data = {} };
+	const auto index_size = Buffer::get_index_size( narrowed.type );
+	narrowed.data.resize( indices.size() * index_size );
+	for ( std::size_t i = 0; i < indices.size(); ++i )
+	{
+		// Little endian, the low bytes are the narrowed index
+		std::memcpy( narrowed.data.data() + i * index_size, &indices[ i ], index_size );
+	}
+	return narrowed;
+}
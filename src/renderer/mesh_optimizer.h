@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <renderer/buffer.h>
+#include <renderer/common.h>
+
+namespace renderer
+{
+	// Index and vertex buffer preprocessing, meant for load time or asset baking. The usual order is:
+	// optimize_vertex_cache(), optimize_overdraw(), optimize_vertex_fetch() then narrow_indices().
+	// All of them work on triangle lists and throw renderer::Error otherwise.
+
+	// Reorders triangles so that vertices are reused while still in the post-transform cache (Tom Forsyth's linear
+	// speed vertex cache optimization)
+	void optimize_vertex_cache( std::span<uint32_t> indices, std::size_t vertex_count );
+
+	// Reorders clusters of a cache optimized index buffer so that outward facing ones are drawn first, which lets depth
+	// testing reject more of what's behind them (Sander et al., Fast Triangle Reordering for Vertex Locality and
+	// Reduced Overdraw). Clusters are split until they lose up to threshold times their cache efficiency.
+	void optimize_overdraw( std::span<uint32_t> indices, std::span<const std::array<float, 3>> positions, float threshold = 1.05f );
+
+	inline constexpr uint32_t UNUSED_VERTEX = static_cast<uint32_t>( -1 );
+
+	// Renumbers vertices in order of first use by the indices, so that vertex fetches are mostly sequential. Returns
+	// the new index of each vertex (see remap_vertices()), UNUSED_VERTEX for the ones no triangle uses.
+	std::vector<uint32_t> optimize_vertex_fetch( std::span<uint32_t> indices, std::size_t vertex_count );
+
+	// Applies the remap of optimize_vertex_fetch() to a vertex stream, unused vertices are dropped
+	template <typename Vertex>
+	std::vector<Vertex> remap_vertices( std::span<const Vertex> vertices, std::span<const uint32_t> remap )
+	{
+		std::size_t count = 0;
+		for ( const auto index : remap )
+		{
+			if ( index != UNUSED_VERTEX )
+			{
+				count = std::max<std::size_t>( count, index + 1zu );
+			}
+		}
+		std::vector<Vertex> result( count );
+		for ( std::size_t i = 0; i < vertices.size(); ++i )
+		{
+			if ( remap[ i ] != UNUSED_VERTEX )
+			{
+				result[ remap[ i ] ] = vertices[ i ];
+			}
+		}
+		return result;
+	}
+
+	struct NarrowedIndices
+	{
+		Buffer::IndexType type;
+		// Ready to upload to an index buffer
+		std::vector<std::byte> data;
+	};
+
+	// Smallest index type that can address every vertex, uint8 only if the device supports it
+	Buffer::IndexType get_index_type( std::size_t vertex_count, bool uint8_support );
+	NarrowedIndices narrow_indices( std::span<const uint32_t> indices, std::size_t vertex_count, bool uint8_support );
+}
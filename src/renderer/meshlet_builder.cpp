@@ -0,0 +1,425 @@
+#include "meshlet_builder.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <renderer/details/profiler.h>
+#include <renderer/device.h>
+#include <renderer/third_party/tbb.h>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define MESHLET_USE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Triangles per parallel task, each chunk ends with a partially filled meshlet
+	constexpr uint32_t CHUNK_TRIANGLES = 16 * 1024;
+	constexpr uint32_t NOT_FOUND = std::numeric_limits<uint32_t>::max();
+	// Local vertex indices are bytes
+	constexpr uint32_t MAX_MESHLET_VERTICES = 256;
+	// Below that (about 85 degrees of spread) backface culling would almost never succeed
+	constexpr float MIN_CONE_DOT = 0.1f;
+
+	// Just enough 3 component vector math for the bounds, 4 wide with SSE
+#ifdef MESHLET_USE_SSE
+	struct Vec
+	{
+		__m128 v;
+	};
+
+	Vec load( const std::array<float, 3>& p ) { return { _mm_setr_ps( p[ 0 ], p[ 1 ], p[ 2 ], 0.f ) }; }
+	Vec splat( float value ) { return { _mm_set1_ps( value ) }; }
+	Vec operator+( Vec a, Vec b ) { return { _mm_add_ps( a.v, b.v ) }; }
+	Vec operator-( Vec a, Vec b ) { return { _mm_sub_ps( a.v, b.v ) }; }
+	Vec operator*( Vec a, Vec b ) { return { _mm_mul_ps( a.v, b.v ) }; }
+	Vec min( Vec a, Vec b ) { return { _mm_min_ps( a.v, b.v ) }; }
+	Vec max( Vec a, Vec b ) { return { _mm_max_ps( a.v, b.v ) }; }
+
+	float dot( Vec a, Vec b )
+	{
+		// w is always 0
+		const __m128 product = _mm_mul_ps( a.v, b.v );
+		const __m128 sum = _mm_add_ps( product, _mm_shuffle_ps( product, product, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+		return _mm_cvtss_f32( _mm_add_ss( sum, _mm_movehl_ps( sum, sum ) ) );
+	}
+
+	Vec cross( Vec a, Vec b )
+	{
+		const __m128 a_yzx = _mm_shuffle_ps( a.v, a.v, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+		const __m128 b_yzx = _mm_shuffle_ps( b.v, b.v, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+		const __m128 c = _mm_sub_ps( _mm_mul_ps( a.v, b_yzx ), _mm_mul_ps( a_yzx, b.v ) );
+		return { _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 0, 2, 1 ) ) };
+	}
+
+	std::array<float, 3> store( Vec a )
+	{
+		alignas( 16 ) std::array<float, 4> values;
+		_mm_store_ps( values.data(), a.v );
+		return { values[ 0 ], values[ 1 ], values[ 2 ] };
+	}
+#else
+	struct Vec
+	{
+		float x, y, z;
+	};
+
+	Vec load( const std::array<float, 3>& p ) { return { p[ 0 ], p[ 1 ], p[ 2 ] }; }
+	Vec splat( float value ) { return { value, value, value }; }
+	Vec operator+( Vec a, Vec b ) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	Vec operator-( Vec a, Vec b ) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	Vec operator*( Vec a, Vec b ) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+	Vec min( Vec a, Vec b ) { return { std::min( a.x, b.x ), std::min( a.y, b.y ), std::min( a.z, b.z ) }; }
+	Vec max( Vec a, Vec b ) { return { std::max( a.x, b.x ), std::max( a.y, b.y ), std::max( a.z, b.z ) }; }
+	float dot( Vec a, Vec b ) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	Vec cross( Vec a, Vec b ) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+	std::array<float, 3> store( Vec a ) { return { a.x, a.y, a.z }; }
+#endif
+
+	// Index of vertex in the meshlet's vertices, 4 at a time with SSE
+	uint32_t find_vertex( const uint32_t* vertices, uint32_t count, uint32_t vertex )
+	{
+		uint32_t i = 0;
+#ifdef MESHLET_USE_SSE
+		const __m128i value = _mm_set1_epi32( static_cast<int>( vertex ) );
+		for ( ; i + 4 <= count; i += 4 )
+		{
+			const __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( vertices + i ) );
+			if ( const int mask = _mm_movemask_ps( _mm_castsi128_ps( _mm_cmpeq_epi32( block, value ) ) ) )
+			{
+				return i + std::countr_zero( static_cast<uint32_t>( mask ) );
+			}
+		}
+#endif
+		for ( ; i < count; ++i )
+		{
+			if ( vertices[ i ] == vertex )
+			{
+				return i;
+			}
+		}
+		return NOT_FOUND;
+	}
+
+	// Triangles using each vertex, in compressed rows
+	struct Adjacency
+	{
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+	};
+
+	Adjacency build_adjacency( std::span<const uint32_t> indices, std::size_t vertex_count )
+	{
+		OPTICK_EVENT();
+		Adjacency adjacency;
+		adjacency.offsets.assign( vertex_count + 1, 0 );
+		for ( const auto index : indices )
+		{
+			++adjacency.offsets[ index + 1 ];
+		}
+		for ( std::size_t vertex = 0; vertex < vertex_count; ++vertex )
+		{
+			adjacency.offsets[ vertex + 1 ] += adjacency.offsets[ vertex ];
+		}
+
+		adjacency.triangles.resize( indices.size() );
+		std::vector<uint32_t> filled( begin( adjacency.offsets ), end( adjacency.offsets ) - 1 );
+		for ( uint32_t i = 0; i < indices.size(); ++i )
+		{
+			adjacency.triangles[ filled[ indices[ i ] ]++ ] = i / 3;
+		}
+		return adjacency;
+	}
+
+	class ChunkBuilder
+	{
+	public:
+		ChunkBuilder( std::span<const uint32_t> indices,
+					  const Adjacency& adjacency,
+					  const renderer::MeshletDesc& desc,
+					  renderer::MeshletMesh& out )
+			: _indices( indices )
+			, _adjacency( &adjacency )
+			, _desc( desc )
+			, _out( &out )
+		{
+		}
+
+		void build( uint32_t first, uint32_t last, std::vector<uint8_t>& emitted )
+		{
+			start_meshlet();
+			uint32_t cursor = first;
+			uint32_t previous = NOT_FOUND;
+			while ( true )
+			{
+				auto triangle = find_neighbour( previous, first, last, emitted );
+				if ( triangle == NOT_FOUND )
+				{
+					while ( cursor < last && emitted[ cursor ] )
+					{
+						++cursor;
+					}
+					if ( cursor == last )
+					{
+						break;
+					}
+					triangle = cursor;
+				}
+
+				if ( _meshlet.triangle_count == _desc.max_triangles
+					 || _meshlet.vertex_count + count_new_vertices( triangle ) > _desc.max_vertices )
+				{
+					finish_meshlet();
+					start_meshlet();
+				}
+				add_triangle( triangle );
+				emitted[ triangle ] = 1;
+				previous = triangle;
+			}
+			finish_meshlet();
+		}
+
+	private:
+		const uint32_t* get_meshlet_vertices() const { return _out->vertices.data() + _meshlet.vertex_offset; }
+
+		// Vertices of the triangle not in the current meshlet yet
+		uint32_t count_new_vertices( uint32_t triangle ) const
+		{
+			const auto* vertices = &_indices[ triangle * 3 ];
+			uint32_t count = 0;
+			for ( uint32_t i = 0; i < 3; ++i )
+			{
+				const bool repeated = ( i > 0 && vertices[ i ] == vertices[ 0 ] ) || ( i > 1 && vertices[ i ] == vertices[ 1 ] );
+				if ( !repeated && find_vertex( get_meshlet_vertices(), _meshlet.vertex_count, vertices[ i ] ) == NOT_FOUND )
+				{
+					++count;
+				}
+			}
+			return count;
+		}
+
+		// Unused triangle of the chunk sharing a vertex with the previous one, the one adding the fewest vertices
+		uint32_t find_neighbour( uint32_t previous, uint32_t first, uint32_t last, const std::vector<uint8_t>& emitted ) const
+		{
+			if ( previous == NOT_FOUND )
+			{
+				return NOT_FOUND;
+			}
+			uint32_t best = NOT_FOUND;
+			uint32_t best_score = 4;
+			for ( uint32_t i = 0; i < 3; ++i )
+			{
+				const auto vertex = _indices[ previous * 3 + i ];
+				for ( auto it = _adjacency->offsets[ vertex ]; it < _adjacency->offsets[ vertex + 1 ]; ++it )
+				{
+					const auto triangle = _adjacency->triangles[ it ];
+					if ( triangle < first || triangle >= last || emitted[ triangle ] )
+					{
+						continue;
+					}
+					const auto score = count_new_vertices( triangle );
+					if ( score < best_score || ( score == best_score && triangle < best ) )
+					{
+						best = triangle;
+						best_score = score;
+					}
+					if ( best_score == 0 )
+					{
+						// Can't do better, also keeps fans around high valence vertices cheap
+						return best;
+					}
+				}
+			}
+			return best;
+		}
+
+		void add_triangle( uint32_t triangle )
+		{
+			for ( uint32_t i = 0; i < 3; ++i )
+			{
+				const auto vertex = _indices[ triangle * 3 + i ];
+				auto local = find_vertex( get_meshlet_vertices(), _meshlet.vertex_count, vertex );
+				if ( local == NOT_FOUND )
+				{
+					_out->vertices.push_back( vertex );
+					local = _meshlet.vertex_count++;
+				}
+				_out->triangles.push_back( static_cast<uint8_t>( local ) );
+			}
+			++_meshlet.triangle_count;
+		}
+
+		void start_meshlet()
+		{
+			_meshlet = {};
+			_meshlet.vertex_offset = static_cast<uint32_t>( _out->vertices.size() );
+			_meshlet.triangle_offset = static_cast<uint32_t>( _out->triangles.size() );
+		}
+
+		void finish_meshlet()
+		{
+			if ( _meshlet.triangle_count == 0 )
+			{
+				return;
+			}
+			_out->triangles.resize( ( _out->triangles.size() + 3 ) & ~std::size_t( 3 ) );
+			_out->meshlets.push_back( _meshlet );
+		}
+
+		std::span<const uint32_t> _indices;
+		const Adjacency* _adjacency;
+		renderer::MeshletDesc _desc;
+		renderer::MeshletMesh* _out;
+		renderer::Meshlet _meshlet {};
+	};
+
+	void compute_bounds( renderer::Meshlet& meshlet, const renderer::MeshletMesh& mesh, std::span<const std::array<float, 3>> positions )
+	{
+		const auto* vertices = &mesh.vertices[ meshlet.vertex_offset ];
+		const auto* triangles = &mesh.triangles[ meshlet.triangle_offset ];
+
+		// Sphere around the bounding box, good enough for small clusters
+		Vec lower = load( positions[ vertices[ 0 ] ] );
+		Vec upper = lower;
+		for ( uint32_t i = 1; i < meshlet.vertex_count; ++i )
+		{
+			const auto p = load( positions[ vertices[ i ] ] );
+			lower = min( lower, p );
+			upper = max( upper, p );
+		}
+		const Vec center = ( lower + upper ) * splat( 0.5f );
+		float radius_squared = 0.f;
+		for ( uint32_t i = 0; i < meshlet.vertex_count; ++i )
+		{
+			const auto offset = load( positions[ vertices[ i ] ] ) - center;
+			radius_squared = std::max( radius_squared, dot( offset, offset ) );
+		}
+		const auto sphere_center = store( center );
+		meshlet.bounding_sphere = { sphere_center[ 0 ], sphere_center[ 1 ], sphere_center[ 2 ], std::sqrt( radius_squared ) };
+
+		// Cone around the average normal, degenerate triangles don't count
+		const auto get_normal = [ & ]( uint32_t triangle, Vec& normal )
+		{
+			const auto a = load( positions[ vertices[ triangles[ triangle * 3 ] ] ] );
+			const auto b = load( positions[ vertices[ triangles[ triangle * 3 + 1 ] ] ] );
+			const auto c = load( positions[ vertices[ triangles[ triangle * 3 + 2 ] ] ] );
+			normal = cross( b - a, c - a );
+			const float length_squared = dot( normal, normal );
+			if ( length_squared <= std::numeric_limits<float>::min() )
+			{
+				return false;
+			}
+			normal = normal * splat( 1.f / std::sqrt( length_squared ) );
+			return true;
+		};
+
+		Vec axis = splat( 0.f );
+		for ( uint32_t triangle = 0; triangle < meshlet.triangle_count; ++triangle )
+		{
+			Vec normal;
+			if ( get_normal( triangle, normal ) )
+			{
+				axis = axis + normal;
+			}
+		}
+		const float axis_length = std::sqrt( dot( axis, axis ) );
+		meshlet.cone_axis = { 0.f, 0.f, 0.f };
+		meshlet.cone_cutoff = 1.f;
+		if ( axis_length <= std::numeric_limits<float>::min() )
+		{
+			return;
+		}
+		axis = axis * splat( 1.f / axis_length );
+
+		float min_dot = 1.f;
+		for ( uint32_t triangle = 0; triangle < meshlet.triangle_count; ++triangle )
+		{
+			Vec normal;
+			if ( get_normal( triangle, normal ) )
+			{
+				min_dot = std::min( min_dot, dot( normal, axis ) );
+			}
+		}
+		meshlet.cone_axis = store( axis );
+		if ( min_dot > MIN_CONE_DOT )
+		{
+			// The normal cone has a half angle of acos( min_dot ), facing away from the camera means being at least 90
+			// degrees past it: cos( angle + 90 ) = -sin( angle )
+			meshlet.cone_cutoff = std::sqrt( 1.f - min_dot * min_dot );
+		}
+	}
+}
+
+renderer::MeshletMesh renderer::build_meshlets( std::span<const uint32_t> indices,
+												std::span<const std::array<float, 3>> positions,
+												const MeshletDesc& desc )
+{
+	OPTICK_EVENT();
+	if ( indices.size() % 3 != 0 )
+	{
+		throw Error( "Meshlets need a triangle list" );
+	}
+	if ( std::ranges::any_of( indices, [ & ]( uint32_t index ) { return index >= positions.size(); } ) )
+	{
+		throw Error( "Mesh index out of the vertex range" );
+	}
+	if ( desc.max_vertices < 3 || desc.max_vertices > MAX_MESHLET_VERTICES || desc.max_triangles == 0 )
+	{
+		throw Error( "Meshlets need 3 to 256 vertices and at least one triangle" );
+	}
+
+	const auto adjacency = build_adjacency( indices, positions.size() );
+	const auto triangle_count = static_cast<uint32_t>( indices.size() / 3 );
+	const auto chunk_count = ( triangle_count + CHUNK_TRIANGLES - 1 ) / CHUNK_TRIANGLES;
+
+	// Chunks only ever touch their own triangles
+	std::vector<uint8_t> emitted( triangle_count, 0 );
+	std::vector<MeshletMesh> chunks( chunk_count );
+	tbb::parallel_for( 0u,
+					   chunk_count,
+					   [ & ]( uint32_t chunk )
+					   {
+						   const auto first = chunk * CHUNK_TRIANGLES;
+						   const auto last = std::min( first + CHUNK_TRIANGLES, triangle_count );
+						   ChunkBuilder( indices, adjacency, desc, chunks[ chunk ] ).build( first, last, emitted );
+					   } );
+
+	MeshletMesh mesh;
+	for ( const auto& chunk : chunks )
+	{
+		const auto vertex_offset = static_cast<uint32_t>( mesh.vertices.size() );
+		const auto triangle_offset = static_cast<uint32_t>( mesh.triangles.size() );
+		for ( auto meshlet : chunk.meshlets )
+		{
+			meshlet.vertex_offset += vertex_offset;
+			meshlet.triangle_offset += triangle_offset;
+			mesh.meshlets.push_back( meshlet );
+		}
+		mesh.vertices.insert( end( mesh.vertices ), begin( chunk.vertices ), end( chunk.vertices ) );
+		mesh.triangles.insert( end( mesh.triangles ), begin( chunk.triangles ), end( chunk.triangles ) );
+	}
+
+	tbb::parallel_for( 0zu,
+					   mesh.meshlets.size(),
+					   [ & ]( std::size_t index ) { compute_bounds( mesh.meshlets[ index ], mesh, positions ); } );
+	return mesh;
+}
+
+renderer::MeshletMesh renderer::build_meshlets( const Device& device,
+												std::span<const uint32_t> indices,
+												std::span<const std::array<float, 3>> positions,
+												const MeshletDesc& desc )
+{
+	const auto& properties = device.get_properties();
+	if ( !properties.mesh_shader_support )
+	{
+		throw Error( "Meshlets need mesh shader support" );
+	}
+	const MeshletDesc clamped {
+		.max_vertices = std::min( { desc.max_vertices, properties.max_mesh_output_vertices, MAX_MESHLET_VERTICES } ),
+		.max_triangles = std::min( desc.max_triangles, properties.max_mesh_output_primitives )
+	};
+	return build_meshlets( indices, positions, clamped );
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <renderer/common.h>
+
+namespace renderer
+{
+	class Device;
+
+	// Matches the GLSL std430 layout
+	struct Meshlet
+	{
+		std::array<float, 4> bounding_sphere; // Center and radius, in mesh space
+		// Normal cone, for culling in task shaders. All triangles face away from the camera when
+		// dot( center - camera, cone_axis ) >= cone_cutoff * length( center - camera ) + radius
+		std::array<float, 3> cone_axis;
+		float cone_cutoff; // 1 when normals are too spread to ever cull
+		uint32_t vertex_offset;	  // In MeshletMesh::vertices
+		uint32_t triangle_offset; // In MeshletMesh::triangles, multiple of 4
+		uint32_t vertex_count;
+		uint32_t triangle_count;
+	};
+
+	struct MeshletMesh
+	{
+		std::vector<Meshlet> meshlets;
+		// Indices into the mesh's vertex buffer
+		std::vector<uint32_t> vertices;
+		// 3 indices into the meshlet's vertices per triangle, padded to 4 bytes per meshlet so shaders can read uints
+		std::vector<uint8_t> triangles;
+	};
+
+	struct MeshletDesc
+	{
+		// Common sweet spot for mesh shader hardware
+		uint32_t max_vertices = 64;
+		uint32_t max_triangles = 124;
+	};
+
+	// Splits an indexed triangle list into meshlets. Triangles are grouped with their neighbours when possible, in
+	// index order otherwise, so meshes should go through optimize_vertex_cache() first. Large meshes are split into chunks
+	// built in parallel.
+	// Throws renderer::Error if indices aren't a triangle list or point outside of positions.
+	MeshletMesh build_meshlets( std::span<const uint32_t> indices,
+								std::span<const std::array<float, 3>> positions,
+								const MeshletDesc& desc = {} );
+	// Limits are clamped to the device's mesh shader outputs (see Device::Properties::max_mesh_output_vertices)
+	MeshletMesh build_meshlets( const Device& device,
+								std::span<const uint32_t> indices,
+								std::span<const std::array<float, 3>> positions,
+								const MeshletDesc& desc = {} );
+}
@@ -0,0 +1,384 @@
+#include "mip_generator.h"
+
+#include <algorithm>
+#include <renderer/details/profiler.h>
+#include <renderer/device.h>
+
+namespace
+{
+	// Workgroups reduce 32x32 texels of the first level (64x64 of the source when it's twice as large) down to 6 levels
+	constexpr uint32_t TILE_SIZE = 32;
+	constexpr int LEVELS_PER_PASS = 6;
+	constexpr uint32_t MAX_LEVEL_EXTENT = TILE_SIZE << LEVELS_PER_PASS;
+	constexpr uint32_t MAX_SOURCE_EXTENT = MAX_LEVEL_EXTENT * 2;
+	static_assert( MAX_LEVEL_EXTENT == renderer::MipGenerator::MAX_DESTINATION_EXTENT );
+	constexpr uint32_t COUNTER_SLOTS = 64;
+
+	constexpr const char* DOWNSAMPLE_SHADER = R"(
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+layout( local_size_x = 256 ) in;
+
+layout( set = 0, binding = 0 ) uniform texture2D textures[];
+layout( set = 0, binding = 1, FORMAT ) uniform coherent image2D images[];
+layout( set = 0, binding = 2 ) uniform sampler samplers[];
+
+layout( buffer_reference, std430, buffer_reference_align = 4 ) coherent buffer Counter
+{
+	uint value;
+};
+
+layout( push_constant ) uniform Constants
+{
+	Counter counter;
+	uint source_index;
+	uint level_count;
+	uvec2 source_extent;
+	uint workgroup_count;
+	uint padding;
+	uint levels[ 12 ];
+};
+
+shared vec4 lds[ 16 ][ 16 ];
+shared bool is_last;
+
+vec4 reduce( vec4 a, vec4 b, vec4 c, vec4 d )
+{
+#if REDUCTION == 0
+	return ( a + b + c + d ) * 0.25;
+#elif REDUCTION == 1
+	return min( min( a, b ), min( c, d ) );
+#else
+	return max( max( a, b ), max( c, d ) );
+#endif
+}
+
+// Level -1 is the source, out of bounds reads are clamped to the edge
+vec4 load( int level, ivec2 p )
+{
+	if ( level < 0 )
+	{
+		p = min( p, ivec2( source_extent ) - 1 );
+		return texelFetch( sampler2D( textures[ source_index ], samplers[ 0 ] ), p, 0 );
+	}
+	p = min( p, imageSize( images[ levels[ level ] ] ) - 1 );
+	return imageLoad( images[ levels[ level ] ], p );
+}
+
+#if REDUCTION != 0
+// Reduces every source texel covered by texel p of level 0, which is up to 3x3 of them when level 0 isn't exactly
+// half the source (odd source extents, power of two pyramids of any extent)
+vec4 load_footprint( ivec2 p )
+{
+	const ivec2 extent = ivec2( source_extent );
+	const ivec2 level_extent = imageSize( images[ levels[ 0 ] ] );
+	const ivec2 first = min( p * extent / level_extent, extent - 1 );
+	const ivec2 last = clamp( ( ( p + 1 ) * extent + level_extent - 1 ) / level_extent - 1, first, extent - 1 );
+#if SAMPLER >= 0
+	// Up to 4 overlapping quads, one reduction sampler fetch each at their shared corner. Rows or columns of a single
+	// texel are sampled at its center instead, where the next texel has no weight.
+	const vec2 offset = vec2( min( last - first + 1, ivec2( 2 ) ) ) * 0.5;
+	const vec2 uv0 = ( vec2( first ) + offset ) / vec2( extent );
+	const vec2 uv1 = ( vec2( last + 1 ) - offset ) / vec2( extent );
+	return reduce( textureLod( sampler2D( textures[ source_index ], samplers[ SAMPLER ] ), uv0, 0.0 ),
+				   textureLod( sampler2D( textures[ source_index ], samplers[ SAMPLER ] ), vec2( uv1.x, uv0.y ), 0.0 ),
+				   textureLod( sampler2D( textures[ source_index ], samplers[ SAMPLER ] ), vec2( uv0.x, uv1.y ), 0.0 ),
+				   textureLod( sampler2D( textures[ source_index ], samplers[ SAMPLER ] ), uv1, 0.0 ) );
+#else
+	vec4 value = load( -1, first );
+	for ( int y = first.y; y <= last.y; ++y )
+	{
+		for ( int x = first.x; x <= last.x; ++x )
+		{
+			const vec4 texel = load( -1, ivec2( x, y ) );
+			value = reduce( value, texel, value, texel );
+		}
+	}
+	return value;
+#endif
+}
+#endif
+
+// Reduces the 2x2 texels of level at p * 2
+vec4 load_quad( int level, ivec2 p )
+{
+#if REDUCTION != 0
+	// Dropping the last row or column of the source would make min/max reductions not conservative
+	if ( level < 0 && any( notEqual( ivec2( source_extent ), imageSize( images[ levels[ 0 ] ] ) * 2 ) ) )
+	{
+		return load_footprint( p );
+	}
+#endif
+#if SAMPLER >= 0
+	// Reduction samplers return the min/max of the 4 texels around the shared corner in a single fetch. Quads
+	// crossing the edge of the source take the clamped path below.
+	if ( level < 0 && all( lessThan( p * 2 + 1, ivec2( source_extent ) ) ) )
+	{
+		const vec2 uv = vec2( p * 2 + 1 ) / vec2( source_extent );
+		return textureLod( sampler2D( textures[ source_index ], samplers[ SAMPLER ] ), uv, 0.0 );
+	}
+#endif
+	return reduce( load( level, p * 2 ),
+				   load( level, p * 2 + ivec2( 1, 0 ) ),
+				   load( level, p * 2 + ivec2( 0, 1 ) ),
+				   load( level, p * 2 + ivec2( 1, 1 ) ) );
+}
+
+void store( int level, ivec2 p, vec4 value )
+{
+	if ( level < level_count && all( lessThan( p, imageSize( images[ levels[ level ] ] ) ) ) )
+	{
+		imageStore( images[ levels[ level ] ], p, value );
+	}
+}
+
+// Reduces level first - 1 into a 32x32 tile of level first and the matching texels of levels first + 1 to first + 5
+void downsample_tile( int first, ivec2 tile )
+{
+	const uint index = gl_LocalInvocationIndex;
+	const ivec2 thread = ivec2( index % 16, index / 16 );
+
+	// 2x2 texels of the first level per thread, which is the footprint of one texel of the next one
+	vec4 texels[ 4 ];
+	for ( int i = 0; i < 4; ++i )
+	{
+		const ivec2 p = tile * 32 + thread * 2 + ivec2( i & 1, i >> 1 );
+		texels[ i ] = load_quad( first - 1, p );
+		store( first, p, texels[ i ] );
+	}
+	const vec4 texel = reduce( texels[ 0 ], texels[ 1 ], texels[ 2 ], texels[ 3 ] );
+	store( first + 1, tile * 16 + thread, texel );
+	lds[ thread.y ][ thread.x ] = texel;
+
+	// Remaining levels go through shared memory: 8x8, 4x4, 2x2 and 1x1 texels
+	for ( int level = first + 2, size = 8; level < first + 6; ++level, size /= 2 )
+	{
+		barrier();
+		const bool active = index < size * size;
+		const ivec2 p = ivec2( index % size, index / size );
+		vec4 value = vec4( 0.0 );
+		if ( active )
+		{
+			value = reduce( lds[ p.y * 2 ][ p.x * 2 ],
+							lds[ p.y * 2 ][ p.x * 2 + 1 ],
+							lds[ p.y * 2 + 1 ][ p.x * 2 ],
+							lds[ p.y * 2 + 1 ][ p.x * 2 + 1 ] );
+			store( level, tile * size + p, value );
+		}
+		barrier();
+		if ( active )
+		{
+			lds[ p.y ][ p.x ] = value;
+		}
+	}
+}
+
+void main()
+{
+	downsample_tile( 0, ivec2( gl_WorkGroupID.xy ) );
+	if ( level_count <= 6 )
+	{
+		return;
+	}
+
+	// The last workgroup to finish sees all of level 5 and reduces it down to the last level
+	memoryBarrierImage();
+	barrier();
+	if ( gl_LocalInvocationIndex == 0 )
+	{
+		is_last = atomicAdd( counter.value, 1 ) == workgroup_count - 1;
+	}
+	barrier();
+	if ( !is_last )
+	{
+		return;
+	}
+	if ( gl_LocalInvocationIndex == 0 )
+	{
+		// Ready for the next dispatch using that counter
+		counter.value = 0;
+	}
+	downsample_tile( 6, ivec2( 0 ) );
+}
+)";
+
+	const char* get_format_qualifier( renderer::Texture::Format format )
+	{
+		switch ( format )
+		{
+			case renderer::Texture::Format::R8G8B8A8_UNORM:
+				return "rgba8";
+			case renderer::Texture::Format::R16G16B16A16_SFLOAT:
+				return "rgba16f";
+			case renderer::Texture::Format::R32_SFLOAT:
+				return "r32f";
+			default:
+				throw renderer::Error( "Texture format not supported by the mip generator" );
+		}
+	}
+
+	// Min/max reduction samplers are only guaranteed for single channel formats
+	bool is_reduction_sampler_supported( renderer::Texture::Format format )
+	{
+		return format == renderer::Texture::Format::R32_SFLOAT || format == renderer::Texture::Format::D32_SFLOAT;
+	}
+
+	bool has_usage( const renderer::Texture& texture, renderer::Texture::Usage usage ) { return ( texture.get_usage() & usage ) == usage; }
+}
+
+renderer::MipGenerator::MipGenerator( Device& device, const BindlessManagerBase& bindless_manager )
+	: _device( &device )
+	, _bindless_manager( &bindless_manager )
+	, _compiler( std::filesystem::path {} )
+	, _counters( device.create_buffer( Buffer::Usage::STORAGE_BUFFER | Buffer::Usage::SHADER_DEVICE_ADDRESS | Buffer::Usage::TRANSFER_DST,
+									   COUNTER_SLOTS * sizeof( uint32_t ) ) )
+{
+}
+
+void renderer::MipGenerator::generate( CommandBuffer& cmd, const BindlessTexture& texture, Reduction reduction )
+{
+	OPTICK_EVENT();
+	const auto& tex = texture.texture;
+	if ( tex.get_mips() < 2 )
+	{
+		return;
+	}
+
+	// The shader only declares 2D views and reads layer 0
+	const auto extent = tex.get_extent();
+	const bool compute = is_supported( tex.get_format() ) && has_usage( tex, Texture::Usage::SAMPLED | Texture::Usage::STORAGE )
+		&& tex.get_type() == Texture::Type::TEXTURE_2D && tex.get_layers() == 1 && !texture.mips.empty()
+		&& tex.get_mips() - 1 <= MAX_LEVELS && std::max( extent.width, extent.height ) <= MAX_SOURCE_EXTENT;
+	if ( !compute )
+	{
+		if ( reduction != Reduction::AVERAGE )
+		{
+			throw Error( "Min/max mip reduction needs the compute path" );
+		}
+		cmd.generate_mips( tex );
+		return;
+	}
+
+	dispatch( cmd, tex, texture.mips[ 0 ].texture_index, 0, texture, 1, reduction );
+}
+
+void renderer::MipGenerator::downsample( CommandBuffer& cmd,
+										 const BindlessTexture& source,
+										 const BindlessTexture& destination,
+										 Reduction reduction )
+{
+	OPTICK_EVENT();
+	for ( const auto& texture : { source.texture, destination.texture } )
+	{
+		if ( texture.get_type() != Texture::Type::TEXTURE_2D || texture.get_layers() > 1 )
+		{
+			throw Error( "Downsample only supports 2D textures with a single layer" );
+		}
+	}
+
+	const auto extent = source.texture.get_extent();
+	const auto level_extent = destination.texture.get_extent();
+	if ( destination.mips.empty() || destination.texture.get_mips() > MAX_LEVELS
+		 || std::max( extent.width, extent.height ) > MAX_SOURCE_EXTENT
+		 || std::max( level_extent.width, level_extent.height ) > MAX_LEVEL_EXTENT || level_extent.width > extent.width
+		 || level_extent.height > extent.height || level_extent.width < extent.width / 2 || level_extent.height < extent.height / 2 )
+	{
+		throw Error( "Downsample destination needs individual mips, at most 12 of them and mip 0 up to 2048x2048 and between "
+					 "half the source (rounded down) and its extent, from a source up to 4096x4096" );
+	}
+
+	// The view of all mips isn't in a single layout while mip 0 is read
+	const auto source_index = source.mips.empty() ? source.handles.texture_index : source.mips[ 0 ].texture_index;
+	dispatch( cmd, source.texture, source_index, 0, destination, 0, reduction );
+}
+
+bool renderer::MipGenerator::is_supported( Texture::Format format )
+{
+	return format == Texture::Format::R8G8B8A8_UNORM || format == Texture::Format::R16G16B16A16_SFLOAT
+		|| format == Texture::Format::R32_SFLOAT;
+}
+
+void renderer::MipGenerator::dispatch( CommandBuffer& cmd,
+									   const Texture& source,
+									   uint32_t source_index,
+									   int source_mip,
+									   const BindlessTexture& destination,
+									   int first_level,
+									   Reduction reduction )
+{
+	const bool sampler_reduction = reduction != Reduction::AVERAGE && _device->get_properties().minmax_filter_support
+		&& is_reduction_sampler_supported( source.get_format() );
+	const auto& pipeline = get_pipeline( destination.texture.get_format(), reduction, sampler_reduction );
+
+	if ( !_counters_cleared )
+	{
+		cmd.fill_buffer( _counters, 0, _counters.get_size(), 0 );
+		cmd.barrier( _counters, Access::TRANSFER_WRITE, Access::COMPUTE_STORAGE_READ_WRITE );
+		_counters_cleared = true;
+	}
+	else if ( _next_counter == 0 )
+	{
+		// Wrapped around, the dispatches that used the counters must have reset them
+		cmd.barrier( _counters, Access::COMPUTE_STORAGE_READ_WRITE, Access::COMPUTE_STORAGE_READ_WRITE );
+	}
+
+	const auto extent = source.get_extent();
+	const Extent2D source_extent { .width = std::max( extent.width >> source_mip, 1u ),
+								   .height = std::max( extent.height >> source_mip, 1u ) };
+	const auto level_extent = destination.texture.get_extent();
+	const uint32_t groups_x = ( std::max( level_extent.width >> first_level, 1u ) + TILE_SIZE - 1 ) / TILE_SIZE;
+	const uint32_t groups_y = ( std::max( level_extent.height >> first_level, 1u ) + TILE_SIZE - 1 ) / TILE_SIZE;
+
+	const int level_count = destination.texture.get_mips() - first_level;
+	PushConstants constants { .counter = _counters.get_device_address() + _next_counter * sizeof( uint32_t ),
+							  .source_index = source_index,
+							  .level_count = static_cast<uint32_t>( level_count ),
+							  .source_extent = source_extent,
+							  .workgroup_count = groups_x * groups_y,
+							  .padding = 0,
+							  .levels = {} };
+	for ( int level = 0; level < level_count; ++level )
+	{
+		constants.levels[ level ] = destination.mips[ first_level + level ].storage_index;
+	}
+	_next_counter = ( _next_counter + 1 ) % COUNTER_SLOTS;
+
+	cmd.use_texture( source, Access::COMPUTE_SHADER_READ, { .base_mip = source_mip, .mip_count = 1 } );
+	cmd.use_texture( destination.texture, Access::COMPUTE_STORAGE_READ_WRITE, { .base_mip = first_level, .mip_count = level_count } );
+	cmd.bind_pipeline( pipeline, *_bindless_manager );
+	cmd.push_constants( pipeline, constants );
+	cmd.dispatch( groups_x, groups_y, 1 );
+}
+
+const renderer::Pipeline& renderer::MipGenerator::get_pipeline( Texture::Format format, Reduction reduction, bool sampler_reduction )
+{
+	const auto key = std::make_tuple( format, reduction, sampler_reduction );
+	if ( const auto it = _pipelines.find( key ); it != end( _pipelines ) )
+	{
+		return it->second;
+	}
+
+	OPTICK_EVENT();
+	int sampler = -1;
+	if ( sampler_reduction )
+	{
+		sampler = static_cast<int>( reduction == Reduction::MIN ? BindlessManagerBase::LINEAR_MIN_SAMPLER.index
+																: BindlessManagerBase::LINEAR_MAX_SAMPLER.index );
+	}
+	ShaderSource source { .path = "mip_generator.comp",
+						  .stage = ShaderStage::COMPUTE,
+						  .defines = { { "FORMAT", get_format_qualifier( format ) },
+									   { "REDUCTION", std::to_string( std::to_underlying( reduction ) ) },
+									   { "SAMPLER", std::to_string( sampler ) } } };
+	auto code = _compiler.compile( std::move( source ), DOWNSAMPLE_SHADER );
+	if ( !code )
+	{
+		throw Error( code.error() );
+	}
+
+	const Pipeline::Desc desc { .push_constants_size = sizeof( PushConstants ) };
+	return _pipelines.emplace( key, _device->create_compute_pipeline( desc, *code, *_bindless_manager ) ).first->second;
+}
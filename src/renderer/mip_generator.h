@@ -0,0 +1,83 @@
+#pragma once
+
+#include <map>
+#include <renderer/bindless.h>
+#include <renderer/buffer.h>
+#include <renderer/command_buffer.h>
+#include <renderer/common.h>
+#include <renderer/pipeline.h>
+#include <renderer/shader_compiler.h>
+#include <renderer/texture.h>
+#include <tuple>
+
+namespace renderer
+{
+	class Device;
+
+	// Generates mip chains on the GPU with a single pass compute downsampler: each workgroup reduces a 32x32 tile of the
+	// first level down to 6 levels, the last workgroup to finish (found through an atomic counter) reduces the remaining levels.
+	// Storage mips are written through the bindless storage image views, textures must be added with individual mips
+	// and have SAMPLED | STORAGE usages. Supported formats: R8G8B8A8_UNORM, R16G16B16A16_SFLOAT and R32_SFLOAT.
+	// Min/max reductions of R32_SFLOAT and D32_SFLOAT sources read them through the reduction samplers when the device
+	// supports them, one fetch per 2x2 texels. When the first level isn't exactly half the source, min/max reduce every
+	// source texel each of its texels covers instead: up to 3x3, with 4 overlapping fetches through the reduction
+	// samplers. Later levels reduce 2x2 texels, they only stay conservative when each of them is exactly half the
+	// previous one (power of two extents).
+	class MipGenerator
+	{
+	public:
+		enum class Reduction
+		{
+			AVERAGE,
+			MIN,
+			MAX
+		};
+
+		// Up to 4096x4096 sources with a single dispatch
+		static constexpr int MAX_LEVELS = 12;
+		// Largest mip 0 of a downsample() destination
+		static constexpr uint32_t MAX_DESTINATION_EXTENT = 2048;
+
+		MipGenerator( Device& device, const BindlessManagerBase& bindless_manager );
+
+		// Fills mips 1 to N from mip 0. Textures the compute path can't handle (including array, cube and 3D ones) fall
+		// back to CommandBuffer::generate_mips(), which only supports AVERAGE.
+		void generate( CommandBuffer& cmd, const BindlessTexture& texture, Reduction reduction = Reduction::AVERAGE );
+		// Fills every mip of destination from mip 0 of source (any sampled format, depth included). Destination mip 0
+		// can have any extent from half the source's (rounded down) to the source's, up to 2048x2048. A power of two
+		// keeps min/max reductions conservative down to the last mip. Both must be single layer 2D textures.
+		void downsample( CommandBuffer& cmd, const BindlessTexture& source, const BindlessTexture& destination, Reduction reduction );
+
+		static bool is_supported( Texture::Format format );
+
+	private:
+		struct PushConstants
+		{
+			vk::DeviceAddress counter;
+			uint32_t source_index;
+			uint32_t level_count;
+			Extent2D source_extent;
+			uint32_t workgroup_count;
+			uint32_t padding;
+			std::array<uint32_t, MAX_LEVELS> levels;
+		};
+
+		void dispatch( CommandBuffer& cmd,
+					   const Texture& source,
+					   uint32_t source_index,
+					   int source_mip,
+					   const BindlessTexture& destination,
+					   int first_level,
+					   Reduction reduction );
+		const Pipeline& get_pipeline( Texture::Format format, Reduction reduction, bool sampler_reduction );
+
+		Device* _device;
+		const BindlessManagerBase* _bindless_manager;
+		ShaderCompiler _compiler;
+		std::map<std::tuple<Texture::Format, Reduction, bool>, raii::Pipeline> _pipelines;
+		// One counter per dispatch so that consecutive dispatches don't need a barrier between them
+		raii::Buffer _counters;
+		uint32_t _next_counter = 0;
+		bool _counters_cleared = false;
+	};
+}
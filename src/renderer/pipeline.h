@@ -45,6 +45,8 @@ namespace renderer
 			PrimitiveTopology topology = PrimitiveTopology::TRIANGLE_LIST;
 			CullMode cull_mode = CullMode::BACK;
 			FrontFace front_face = FrontFace::COUNTER_CLOCKWISE;
+			// Multiview: one bit per layer of the attachments, must match CommandBuffer::begin_rendering()
+			uint32_t view_mask = 0;
 			// Compute & graphics pipelines
 			uint32_t push_constants_size = 0;
 		};
@@ -86,18 +88,17 @@ namespace renderer
 			Pipeline() = default;
 
 		private:
-			Pipeline( vk::raii::PipelineLayout&& layout,
+			// Layout is owned by the device cache and shared between pipelines
+			Pipeline( vk::PipelineLayout layout,
 					  vk::raii::Pipeline&& pipeline,
 					  const Pipeline::Desc& desc,
 					  vk::ShaderStageFlags used_stages,
 					  Type type )
-				: renderer::Pipeline( *layout, *pipeline, desc, used_stages, type )
-				, _layout( std::move( layout ) )
+				: renderer::Pipeline( layout, *pipeline, desc, used_stages, type )
 				, _pipeline( std::move( pipeline ) )
 			{
 			}
 
-			vk::raii::PipelineLayout _layout = nullptr;
 			vk::raii::Pipeline _pipeline = nullptr;
 			friend class renderer::Device;
 		};
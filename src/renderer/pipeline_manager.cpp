@@ -1,5 +1,7 @@
 #include "pipeline_manager.h"
 
+#include <algorithm>
+#include <map>
 #include <renderer/details/profiler.h>
 #include <renderer/device.h>
 #include <renderer/third_party/tbb.h>
@@ -17,6 +19,47 @@ namespace
 		return std::move( compilation_result.value() );
 	}
 
+	// FNV-1a, good enough to bucket SPIR-V blobs before doing a full compare
+	uint64_t hash_spirv( const renderer::raii::ShaderCode& code )
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for ( const auto word : std::span( code.get_data(), code.get_size() ) )
+		{
+			hash = ( hash ^ word ) * 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	bool same_spirv( const renderer::raii::ShaderCode& lhs, const renderer::raii::ShaderCode& rhs )
+	{
+		return lhs.get_source().stage == rhs.get_source().stage
+			&& std::ranges::equal( std::span( lhs.get_data(), lhs.get_size() ), std::span( rhs.get_data(), rhs.get_size() ) );
+	}
+
+	std::vector<std::vector<renderer::ShaderSource::Define>> expand_permutations( std::span<const renderer::ShaderDefineAxis> axes )
+	{
+		std::vector<std::vector<renderer::ShaderSource::Define>> permutations( 1 );
+		for ( const auto& axis : axes )
+		{
+			if ( axis.values.empty() )
+			{
+				continue;
+			}
+			std::vector<std::vector<renderer::ShaderSource::Define>> expanded;
+			expanded.reserve( permutations.size() * axis.values.size() );
+			for ( const auto& permutation : permutations )
+			{
+				for ( const auto& value : axis.values )
+				{
+					auto& defines = expanded.emplace_back( permutation );
+					defines.push_back( { axis.key, value } );
+				}
+			}
+			permutations = std::move( expanded );
+		}
+		return permutations;
+	}
+
 	// XXX: TBB seems to creates a different scheduler/arena for jthreads
 	// We discovered this because we had to set a different observer instance to see the TBB workers used by the bindless manager
 
@@ -33,9 +76,17 @@ namespace
 }
 
 renderer::PipelineManager::PipelineManager( Device& device, std::filesystem::path shader_dir, const BindlessManagerBase& bindless_manager )
+	: PipelineManager( device, std::move( shader_dir ), bindless_manager, ShaderCompiler::PostProcess {} )
+{
+}
+
+renderer::PipelineManager::PipelineManager( Device& device,
+											std::filesystem::path shader_dir,
+											const BindlessManagerBase& bindless_manager,
+											const ShaderCompiler::PostProcess& post_process )
 	: _device( &device )
 	, _bindless_manager( &bindless_manager )
-	, _compiler( std::move( shader_dir ) )
+	, _compiler( std::move( shader_dir ), post_process )
 	, _rebuild_thread(
 		  [ & ]( std::stop_token tok )
 		  {
@@ -77,6 +128,114 @@ renderer::PipelineHandle renderer::PipelineManager::add( Pipeline::Desc desc, st
 	return handle;
 }
 
+renderer::PipelinePermutations renderer::PipelineManager::add_permutations( Pipeline::Desc desc,
+																			 std::initializer_list<ShaderSource> sources,
+																			 std::span<const ShaderDefineAxis> axes )
+{
+	OPTICK_EVENT();
+	struct CompileRequest
+	{
+		ShaderSource source;
+		std::filesystem::file_time_type last_write;
+		std::expected<raii::ShaderCode, Error> result;
+	};
+
+	const auto permutations = expand_permutations( axes );
+	std::vector<CompileRequest> requests;
+	requests.reserve( permutations.size() * sources.size() );
+	for ( const auto& defines : permutations )
+	{
+		for ( const auto& source : sources )
+		{
+			// Grab the timestamp before compiling so that a write during compilation still triggers a rebuild
+			std::error_code ec;
+			auto last_write = std::filesystem::last_write_time( _compiler.get_base_directory() / source.path, ec );
+			auto& request = requests.emplace_back( source, ec ? std::filesystem::file_time_type::min() : last_write );
+			request.source.defines.insert( end( request.source.defines ), begin( defines ), end( defines ) );
+		}
+	}
+
+	tbb::parallel_for( 0zu,
+					   requests.size(),
+					   [ & ]( size_t index ) { requests[ index ].result = compile_shader( _compiler, requests[ index ].source ); } );
+
+	// Dedupe identical modules, permutations of a define the shader doesn't use (or that is optimized out) will collapse
+	std::unordered_multimap<uint64_t, uint32_t> known_modules;
+	std::vector<uint32_t> unique_modules;
+	std::vector<uint32_t> module_indices( requests.size() );
+	for ( uint32_t i = 0; i < requests.size(); ++i )
+	{
+		if ( !requests[ i ].result )
+		{
+			throw requests[ i ].result.error();
+		}
+		const auto& code = requests[ i ].result.value();
+		const auto hash = hash_spirv( code );
+		const auto [ first, last ] = known_modules.equal_range( hash );
+		const auto it = std::find_if( first,
+									  last,
+									  [ & ]( const auto& entry )
+									  { return same_spirv( requests[ unique_modules[ entry.second ] ].result.value(), code ); } );
+		if ( it != last )
+		{
+			module_indices[ i ] = it->second;
+		}
+		else
+		{
+			module_indices[ i ] = static_cast<uint32_t>( unique_modules.size() );
+			known_modules.emplace( hash, module_indices[ i ] );
+			unique_modules.push_back( i );
+		}
+	}
+
+	PipelinePermutations result;
+	result.handles.reserve( permutations.size() );
+	result.unique_modules = static_cast<uint32_t>( unique_modules.size() );
+
+	std::unique_lock lock( _mtx );
+	// Every permutation keeps its own sources so that hot reload can tell when deduped ones diverge
+	std::vector<int> shader_indices( requests.size() );
+	for ( uint32_t i = 0; i < requests.size(); ++i )
+	{
+		auto& request = requests[ i ];
+		auto it = std::find_if( begin( _shaders ),
+								end( _shaders ),
+								[ &request ]( const auto& shader ) { return shader.code.get_source() == request.source; } );
+		if ( it == end( _shaders ) )
+		{
+			_shaders.emplace_back( std::move( request.result.value() ), request.last_write );
+			it = end( _shaders ) - 1;
+		}
+		shader_indices[ i ] = static_cast<int>( std::distance( begin( _shaders ), it ) );
+	}
+
+	// Permutations made of the same modules alias the first one's pipeline, see rebuild_job()
+	std::map<std::vector<uint32_t>, PipelineHandle> pipelines;
+	for ( size_t permutation = 0; permutation < permutations.size(); ++permutation )
+	{
+		const auto handle = static_cast<PipelineHandle>( _items.size() );
+		auto& entry = _items.emplace_back( desc );
+		std::vector<uint32_t> modules;
+		modules.reserve( sources.size() );
+		entry.sources.reserve( sources.size() );
+		for ( size_t stage = 0; stage < sources.size(); ++stage )
+		{
+			modules.push_back( module_indices[ permutation * sources.size() + stage ] );
+			entry.sources.push_back( shader_indices[ permutation * sources.size() + stage ] );
+		}
+		auto [ it, inserted ] = pipelines.try_emplace( std::move( modules ), handle );
+		if ( !inserted )
+		{
+			entry.alias = it->second;
+			// Aliases don't need building, only wait_ready() on the pipeline they point to
+			++_available_pipelines;
+		}
+		result.handles.push_back( handle );
+	}
+	result.unique_pipelines = static_cast<uint32_t>( pipelines.size() );
+	return result;
+}
+
 void renderer::PipelineManager::update()
 {
 	OPTICK_EVENT();
@@ -89,8 +248,14 @@ void renderer::PipelineManager::update()
 		// Preserve working shaders if the new ones failed to compile/link
 		if ( result )
 		{
-			_device->queue_deletion( std::move( std::get<raii::Pipeline>( _items[ handle ].pipeline ) ) );
-			_items[ handle ].pipeline = std::move( result.value() );
+			auto& item = _items[ handle ];
+			if ( const auto previous = std::get_if<raii::Pipeline>( &item.pipeline ) )
+			{
+				_device->queue_deletion( std::move( *previous ) );
+			}
+			// An alias that got its own pipeline has diverged from the one it shared with
+			item.pipeline = std::move( result.value() );
+			item.alias.reset();
 		}
 	}
 	_updated_items.clear();
@@ -98,7 +263,8 @@ void renderer::PipelineManager::update()
 
 renderer::Pipeline renderer::PipelineManager::get( PipelineHandle pipeline ) const
 {
-	return std::get<raii::Pipeline>( _items[ pipeline ].pipeline );
+	const auto& item = _items[ pipeline ];
+	return std::get<raii::Pipeline>( _items[ item.alias.value_or( pipeline ) ].pipeline );
 }
 
 void renderer::PipelineManager::wait_ready()
@@ -136,6 +302,14 @@ renderer::PipelineManager::MakePipelineResult renderer::PipelineManager::make( c
 	}
 }
 
+bool renderer::PipelineManager::same_code( const Item& lhs, const Item& rhs ) const
+{
+	return std::ranges::equal( lhs.sources,
+							   rhs.sources,
+							   [ this ]( int lhs_source, int rhs_source )
+							   { return same_spirv( _shaders[ lhs_source ].code, _shaders[ rhs_source ].code ); } );
+}
+
 std::vector<int> renderer::PipelineManager::rebuild_outdated_shaders()
 {
 	OPTICK_EVENT();
@@ -221,6 +395,20 @@ void renderer::PipelineManager::rebuild_job()
 				++rebuilt;
 			}
 		}
+		if ( const auto alias = _items[ i ].alias )
+		{
+			// Split from the pipeline it shares once a reload makes the sources compile to something else
+			if ( available == _items[ i ].sources.size() && rebuilt > 0 && !same_code( _items[ i ], _items[ *alias ] ) )
+			{
+				shaders.clear();
+				for ( const auto source : _items[ i ].sources )
+				{
+					shaders.push_back( &_shaders[ source ].code );
+				}
+				_updated_items.insert_or_assign( i, make( std::get<Pipeline::Desc>( _items[ i ].pipeline ), shaders ) );
+			}
+			continue;
+		}
 		const auto unbuilt_desc = std::get_if<Pipeline::Desc>( &_items[ i ].pipeline );
 		if ( available == _items[ i ].sources.size() && ( unbuilt_desc || rebuilt > 0 ) )
 		{
@@ -4,6 +4,7 @@
 #include <expected>
 #include <filesystem>
 #include <mutex>
+#include <optional>
 #include <renderer/common.h>
 #include <renderer/pipeline.h>
 #include <renderer/shader.h>
@@ -21,6 +22,15 @@ namespace renderer
 
 	using PipelineHandle = uint32_t;
 
+	struct PipelinePermutations
+	{
+		// One handle per permutation, in cross product order (last axis varies fastest)
+		// Permutations that compile to the same SPIR-V for every stage share the same pipeline until a hot reload makes them diverge
+		std::vector<PipelineHandle> handles;
+		uint32_t unique_modules = 0;
+		uint32_t unique_pipelines = 0;
+	};
+
 	class PipelineManager
 	{
 		struct Shader
@@ -33,15 +43,26 @@ namespace renderer
 		{
 			std::variant<Pipeline::Desc, raii::Pipeline> pipeline;
 			std::vector<int> sources;
+			// Set while the sources compile to the same SPIR-V as another item's, whose pipeline is used instead
+			std::optional<PipelineHandle> alias;
 		};
 
 		using MakePipelineResult = std::expected<raii::Pipeline, Error>;
 
 	public:
 		PipelineManager( Device& device, std::filesystem::path shader_dir, const BindlessManagerBase& bindless_manager );
+		PipelineManager( Device& device,
+						 std::filesystem::path shader_dir,
+						 const BindlessManagerBase& bindless_manager,
+						 const ShaderCompiler::PostProcess& post_process );
 
 		// Creates and return new pipeline. Safe to call from multiple threads at once.
 		PipelineHandle add( Pipeline::Desc desc, std::initializer_list<ShaderSource> shaders );
+		// Compiles the cross product of the define axes (on top of each shader own defines) in parallel and registers one pipeline
+		// per unique combination of SPIR-V modules. Blocks until compilation is done and throws if any permutation fails to compile.
+		// Safe to call from multiple threads at once.
+		PipelinePermutations
+		add_permutations( Pipeline::Desc desc, std::initializer_list<ShaderSource> shaders, std::span<const ShaderDefineAxis> axes );
 		// Updates any outdated pipeline from the async thread if avaible. Does not wait for pending updates.
 		// Call each frame before rendering to get updated shaders.
 		void update();
@@ -54,6 +75,7 @@ namespace renderer
 
 	private:
 		MakePipelineResult make( const Pipeline::Desc& desc, std::span<const raii::ShaderCode*> shaders ) const;
+		bool same_code( const Item& lhs, const Item& rhs ) const;
 		std::vector<int> rebuild_outdated_shaders();
 		void rebuild_job();
 
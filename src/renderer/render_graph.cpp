@@ -0,0 +1,539 @@
+#include "render_graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <ranges>
+#include <renderer/command_buffer.h>
+#include <renderer/details/profiler.h>
+
+namespace
+{
+	using Queue = renderer::Device::Queue;
+
+	// Per resource bookkeeping while building dependencies
+	struct ResourceHazards
+	{
+		uint32_t last_writer = -1;
+		std::vector<uint32_t> readers; // Since last write
+		renderer::Texture::Layout readers_layout = renderer::Texture::Layout::UNDEFINED;
+	};
+
+	void add_dependency( std::vector<uint32_t>& dependencies, uint32_t pass, uint32_t self )
+	{
+		if ( pass != uint32_t( -1 ) && pass != self && std::ranges::find( dependencies, pass ) == end( dependencies ) )
+		{
+			dependencies.push_back( pass );
+		}
+	}
+
+	// Layout transitions are writes too, readers in different layouts can't run concurrently
+	void track_hazard( ResourceHazards& hazards, std::vector<uint32_t>& dependencies, uint32_t pass, const renderer::AccessInfo& info )
+	{
+		const bool layout_change = !hazards.readers.empty() && hazards.readers_layout != info.layout;
+		if ( info.is_write() || layout_change )
+		{
+			add_dependency( dependencies, hazards.last_writer, pass );
+			for ( auto reader : hazards.readers )
+			{
+				add_dependency( dependencies, reader, pass );
+			}
+			if ( info.is_write() )
+			{
+				hazards.last_writer = pass;
+				hazards.readers.clear();
+			}
+			else
+			{
+				// Later readers in the new layout must wait for this one, later writers too
+				hazards.last_writer = pass;
+				hazards.readers = { pass };
+				hazards.readers_layout = info.layout;
+			}
+		}
+		else
+		{
+			add_dependency( dependencies, hazards.last_writer, pass );
+			hazards.readers.push_back( pass );
+			hazards.readers_layout = info.layout;
+		}
+	}
+
+	int queue_index( Queue queue ) { return queue == Queue::GRAPHICS ? 0 : 1; }
+}
+
+renderer::RenderGraph::PassBuilder& renderer::RenderGraph::PassBuilder::use( TextureRef texture, Access access, TextureSubresource range )
+{
+	assert( texture.index < _graph->_textures.size() );
+	_graph->_passes[ _pass ].textures.push_back( TextureUse { texture.index, access, range } );
+	return *this;
+}
+
+renderer::RenderGraph::PassBuilder& renderer::RenderGraph::PassBuilder::use( BufferRef buffer, Access access )
+{
+	assert( buffer.index < _graph->_buffers.size() );
+	_graph->_passes[ _pass ].buffers.push_back( BufferUse { buffer.index, access } );
+	return *this;
+}
+
+renderer::RenderGraph::PassBuilder& renderer::RenderGraph::PassBuilder::set_side_effects()
+{
+	_graph->_passes[ _pass ].side_effects = true;
+	return *this;
+}
+
+renderer::RenderGraph::RenderGraph( Device& device )
+	: _device( &device )
+	, _transient_pool( device )
+{
+	if ( device.get_properties().async_compute_support )
+	{
+		_graphics_timeline = device.create_timeline_semaphore();
+		_compute_timeline = device.create_timeline_semaphore();
+	}
+}
+
+renderer::RenderGraph::TextureRef renderer::RenderGraph::import_texture( const Texture& texture )
+{
+	_textures.push_back( TextureResource { .texture = texture } );
+	return TextureRef { uint32_t( _textures.size() - 1 ) };
+}
+
+renderer::RenderGraph::BufferRef renderer::RenderGraph::import_buffer( const Buffer& buffer, Access initial_access )
+{
+	_buffers.push_back( BufferResource { .buffer = buffer, .state = get_access_info( initial_access ) } );
+	return BufferRef { uint32_t( _buffers.size() - 1 ) };
+}
+
+renderer::RenderGraph::TextureRef renderer::RenderGraph::create_texture( const Texture::Desc& desc )
+{
+	_textures.push_back( TextureResource { .transient_desc = desc } );
+	return TextureRef { uint32_t( _textures.size() - 1 ) };
+}
+
+renderer::RenderGraph::BufferRef renderer::RenderGraph::create_buffer( Buffer::Usage usage, std::size_t size )
+{
+	_buffers.push_back( BufferResource { .transient_desc = std::pair( usage, size ) } );
+	return BufferRef { uint32_t( _buffers.size() - 1 ) };
+}
+
+renderer::TextureView renderer::RenderGraph::get_texture_view( TextureRef texture ) const
+{
+	assert( _textures[ texture.index ].transient_index != uint32_t( -1 ) );
+	return _transient_pool.get_texture_view( _textures[ texture.index ].transient_index );
+}
+
+void renderer::RenderGraph::set_output( TextureRef texture )
+{
+	assert( texture.index < _textures.size() );
+	_texture_outputs.push_back( texture.index );
+}
+
+void renderer::RenderGraph::set_output( BufferRef buffer )
+{
+	assert( buffer.index < _buffers.size() );
+	_buffer_outputs.push_back( buffer.index );
+}
+
+renderer::RenderGraph::PassBuilder renderer::RenderGraph::add_pass( std::string name, ExecuteFn execute, Queue queue )
+{
+	if ( !_compute_timeline )
+	{
+		queue = Queue::GRAPHICS;
+	}
+	_passes.push_back( Pass { .name = std::move( name ), .execute = std::move( execute ), .queue = queue } );
+	return PassBuilder( *this, _passes.size() - 1 );
+}
+
+void renderer::RenderGraph::compile()
+{
+	OPTICK_EVENT();
+	cull_passes();
+	build_dependencies();
+	const auto order = schedule_passes();
+
+	// The last graphics segment is submitted by the caller, after execute() returned. Async compute passes depending on it
+	// can't be submitted by the graph so they are moved to the graphics queue until there is none left.
+	bool demoted = true;
+	while ( demoted )
+	{
+		build_segments( order );
+		demoted = false;
+		for ( auto& pass : _passes )
+		{
+			if ( !pass.culled && pass.queue == Queue::ASYNC_COMPUTE
+				 && std::ranges::any_of( pass.dependencies, [ & ]( auto dep ) { return _passes[ dep ].segment == _final_segment; } ) )
+			{
+				pass.queue = Queue::GRAPHICS;
+				demoted = true;
+			}
+		}
+	}
+
+	allocate_transients( order );
+
+	_statistics = { .passes = uint32_t( _passes.size() ) };
+	for ( const auto& pass : _passes )
+	{
+		_statistics.culled_passes += pass.culled;
+		_statistics.async_compute_passes += !pass.culled && pass.queue == Queue::ASYNC_COMPUTE;
+	}
+}
+
+void renderer::RenderGraph::cull_passes()
+{
+	std::vector<bool> needed_textures( _textures.size() );
+	std::vector<bool> needed_buffers( _buffers.size() );
+	for ( auto index : _texture_outputs )
+	{
+		needed_textures[ index ] = true;
+	}
+	for ( auto index : _buffer_outputs )
+	{
+		needed_buffers[ index ] = true;
+	}
+
+	// Walk backward, a pass is needed if it writes to something needed by an output or a later needed pass.
+	// Writes aren't assumed to overwrite the whole resource (partial updates, load ops...) so everything used
+	// by a needed pass becomes needed, including what it writes.
+	for ( auto& pass : _passes | std::views::reverse )
+	{
+		pass.culled = !pass.side_effects
+			&& std::ranges::none_of( pass.textures,
+									 [ & ]( const auto& use )
+									 { return needed_textures[ use.texture ] && get_access_info( use.access ).is_write(); } )
+			&& std::ranges::none_of( pass.buffers,
+									 [ & ]( const auto& use )
+									 { return needed_buffers[ use.buffer ] && get_access_info( use.access ).is_write(); } );
+		if ( !pass.culled )
+		{
+			for ( const auto& use : pass.textures )
+			{
+				needed_textures[ use.texture ] = true;
+			}
+			for ( const auto& use : pass.buffers )
+			{
+				needed_buffers[ use.buffer ] = true;
+			}
+		}
+	}
+}
+
+void renderer::RenderGraph::build_dependencies()
+{
+	std::vector<ResourceHazards> texture_hazards( _textures.size() );
+	std::vector<ResourceHazards> buffer_hazards( _buffers.size() );
+
+	for ( uint32_t index = 0; index < _passes.size(); ++index )
+	{
+		auto& pass = _passes[ index ];
+		pass.dependencies.clear();
+		if ( pass.culled )
+		{
+			continue;
+		}
+		for ( const auto& use : pass.textures )
+		{
+			track_hazard( texture_hazards[ use.texture ], pass.dependencies, index, get_access_info( use.access ) );
+		}
+		for ( const auto& use : pass.buffers )
+		{
+			auto info = get_access_info( use.access );
+			info.layout = Texture::Layout::UNDEFINED;
+			track_hazard( buffer_hazards[ use.buffer ], pass.dependencies, index, info );
+		}
+	}
+}
+
+std::vector<uint32_t> renderer::RenderGraph::schedule_passes() const
+{
+	// Greedy topological sort. Among ready passes, pick the one whose dependencies were scheduled the earliest so that
+	// producers and consumers end up far apart, letting the GPU overlap work between them. Ties keep declaration order.
+	std::vector<uint32_t> remaining( _passes.size() );
+	std::vector<std::vector<uint32_t>> successors( _passes.size() );
+	std::vector<int> position( _passes.size(), -1 );
+	std::vector<uint32_t> ready;
+	for ( uint32_t index = 0; index < _passes.size(); ++index )
+	{
+		const auto& pass = _passes[ index ];
+		if ( pass.culled )
+		{
+			continue;
+		}
+		remaining[ index ] = pass.dependencies.size();
+		for ( auto dep : pass.dependencies )
+		{
+			successors[ dep ].push_back( index );
+		}
+		if ( pass.dependencies.empty() )
+		{
+			ready.push_back( index );
+		}
+	}
+
+	std::vector<uint32_t> order;
+	order.reserve( _passes.size() );
+	while ( !ready.empty() )
+	{
+		const auto latest_dependency = [ & ]( uint32_t index )
+		{
+			int latest = -1;
+			for ( auto dep : _passes[ index ].dependencies )
+			{
+				latest = std::max( latest, position[ dep ] );
+			}
+			return std::pair( latest, index );
+		};
+		const auto next = std::ranges::min_element( ready, {}, latest_dependency );
+		const auto index = *next;
+		ready.erase( next );
+
+		position[ index ] = order.size();
+		order.push_back( index );
+		for ( auto successor : successors[ index ] )
+		{
+			if ( --remaining[ successor ] == 0 )
+			{
+				ready.push_back( successor );
+			}
+		}
+	}
+	return order;
+}
+
+void renderer::RenderGraph::build_segments( std::span<const uint32_t> order )
+{
+	_segments.clear();
+	_final_segment = -1;
+
+	// A segment is closed as soon as the other queue depends on it, so that it can signal once its passes are done.
+	// Waits always point to segments created earlier, submitting in creation order never deadlocks.
+	std::array<uint32_t, 2> open_segments = { uint32_t( -1 ), uint32_t( -1 ) };
+	for ( auto index : order )
+	{
+		auto& pass = _passes[ index ];
+		std::vector<uint32_t> waits;
+		for ( auto dep : pass.dependencies )
+		{
+			const auto& dep_pass = _passes[ dep ];
+			if ( dep_pass.queue != pass.queue )
+			{
+				if ( std::ranges::find( waits, dep_pass.segment ) == end( waits ) )
+				{
+					waits.push_back( dep_pass.segment );
+				}
+				auto& open = open_segments[ queue_index( dep_pass.queue ) ];
+				if ( open == dep_pass.segment )
+				{
+					open = -1;
+				}
+			}
+		}
+
+		auto& open = open_segments[ queue_index( pass.queue ) ];
+		if ( open == uint32_t( -1 ) || !waits.empty() )
+		{
+			_segments.push_back( Segment { .queue = pass.queue, .waits = std::move( waits ) } );
+			open = _segments.size() - 1;
+		}
+		_segments[ open ].passes.push_back( index );
+		pass.segment = open;
+	}
+
+	for ( uint32_t index = 0; index < _segments.size(); ++index )
+	{
+		if ( _segments[ index ].queue == Queue::GRAPHICS )
+		{
+			_final_segment = index;
+		}
+	}
+}
+
+void renderer::RenderGraph::allocate_transients( std::span<const uint32_t> order )
+{
+	// Lifetimes in schedule positions. Textures used on the async compute queue live for the whole frame,
+	// there would be no barrier between them and the textures sharing their memory on the graphics queue.
+	std::vector<TransientPool::TextureRequest> requests;
+	std::vector<uint32_t> request_textures;
+	std::vector<bool> whole_frame;
+	for ( uint32_t position = 0; position < order.size(); ++position )
+	{
+		const auto& pass = _passes[ order[ position ] ];
+		for ( const auto& use : pass.textures )
+		{
+			auto& resource = _textures[ use.texture ];
+			if ( !resource.transient_desc )
+			{
+				continue;
+			}
+			if ( resource.transient_index == uint32_t( -1 ) )
+			{
+				resource.transient_index = requests.size();
+				requests.push_back( TransientPool::TextureRequest { .desc = *resource.transient_desc, .first_use = position } );
+				request_textures.push_back( use.texture );
+				whole_frame.push_back( false );
+			}
+			requests[ resource.transient_index ].last_use = position;
+			whole_frame[ resource.transient_index ] = whole_frame[ resource.transient_index ] || pass.queue == Queue::ASYNC_COMPUTE;
+		}
+
+		// Buffers aren't aliased, only reused across frames
+		for ( const auto& use : pass.buffers )
+		{
+			auto& resource = _buffers[ use.buffer ];
+			if ( resource.transient_desc && !resource.pooled )
+			{
+				resource.pooled = &_transient_pool.acquire_buffer( resource.transient_desc->first, resource.transient_desc->second );
+				resource.buffer = resource.pooled->buffer;
+				resource.state = resource.pooled->last_access;
+			}
+		}
+	}
+	for ( uint32_t index = 0; index < requests.size(); ++index )
+	{
+		if ( whole_frame[ index ] )
+		{
+			requests[ index ].first_use = 0;
+			requests[ index ].last_use = order.size();
+		}
+	}
+
+	const auto textures = _transient_pool.allocate_textures( requests );
+	for ( uint32_t index = 0; index < requests.size(); ++index )
+	{
+		_textures[ request_textures[ index ] ].texture = textures[ index ];
+	}
+}
+
+void renderer::RenderGraph::execute( CommandBuffer& cmd, uint32_t frame_index )
+{
+	OPTICK_EVENT();
+	auto& command_buffers = _command_buffers[ frame_index ];
+	auto& frame_values = _frame_values[ frame_index ];
+	if ( _compute_timeline && !command_buffers.empty() )
+	{
+		const std::array<SemaphoreValue, 2> previous_values { SemaphoreValue { *_graphics_timeline, frame_values[ 0 ] },
+															  SemaphoreValue { *_compute_timeline, frame_values[ 1 ] } };
+		_device->wait_for_semaphores( previous_values, UINT64_MAX );
+	}
+
+	// Tracked states don't cover queues, the first segment of each queue waits for everything the other queue
+	// submitted so far to avoid hazards with previous frames
+	const std::array<uint64_t, 2> previous_frame_values = { _graphics_value, _compute_value };
+	std::array<bool, 2> first_segment = { true, true };
+
+	std::vector<uint64_t> signal_values( _segments.size() );
+	uint32_t used_command_buffers = 0;
+	_final_waits.clear();
+	_final_signals.clear();
+
+	for ( uint32_t index = 0; index < _segments.size(); ++index )
+	{
+		const auto& segment = _segments[ index ];
+		const auto queue = queue_index( segment.queue );
+		const auto other_queue = segment.queue == Queue::GRAPHICS ? Queue::ASYNC_COMPUTE : Queue::GRAPHICS;
+
+		std::vector<SemaphoreValue> waits;
+		for ( auto wait : segment.waits )
+		{
+			waits.push_back( SemaphoreValue { get_timeline( other_queue ), signal_values[ wait ] } );
+		}
+		if ( first_segment[ queue ] && previous_frame_values[ 1 - queue ] > 0 )
+		{
+			waits.push_back( SemaphoreValue { get_timeline( other_queue ), previous_frame_values[ 1 - queue ] } );
+		}
+		first_segment[ queue ] = false;
+
+		if ( index == _final_segment )
+		{
+			for ( auto pass : segment.passes )
+			{
+				record_pass( cmd, _passes[ pass ] );
+			}
+			_final_waits = std::move( waits );
+			if ( _graphics_timeline )
+			{
+				signal_values[ index ] = ++_graphics_value;
+				_final_signals.push_back( SemaphoreValue { *_graphics_timeline, _graphics_value } );
+			}
+			continue;
+		}
+
+		if ( used_command_buffers == command_buffers.size() )
+		{
+			command_buffers.push_back( _device->grab_command_buffer() );
+		}
+		auto& segment_cmd = *command_buffers[ used_command_buffers++ ];
+		segment_cmd.begin();
+		for ( auto pass : segment.passes )
+		{
+			record_pass( segment_cmd, _passes[ pass ] );
+		}
+		segment_cmd.end();
+
+		auto& value = segment.queue == Queue::GRAPHICS ? _graphics_value : _compute_value;
+		signal_values[ index ] = ++value;
+		const SemaphoreValue signal { get_timeline( segment.queue ), value };
+		_device->submit( segment.queue, segment_cmd, waits, std::span( &signal, 1 ) );
+		++_statistics.submissions;
+	}
+
+	frame_values = { _graphics_value, _compute_value };
+
+	for ( auto& resource : _buffers )
+	{
+		if ( resource.pooled )
+		{
+			resource.pooled->last_access = resource.state;
+		}
+	}
+}
+
+void renderer::RenderGraph::record_pass( CommandBuffer& cmd, const Pass& pass )
+{
+	for ( const auto& use : pass.textures )
+	{
+		auto& resource = _textures[ use.texture ];
+		if ( resource.transient_desc && !resource.alive )
+		{
+			_transient_pool.begin_lifetime( resource.transient_index );
+			resource.alive = true;
+		}
+		cmd.use_texture( resource.texture, use.access, use.range );
+	}
+	for ( const auto& use : pass.buffers )
+	{
+		auto& resource = _buffers[ use.buffer ];
+		const auto next = get_access_info( use.access );
+		if ( !resource.state.is_write() && !next.is_write() )
+		{
+			// Read after read, later writes will have to wait for all readers
+			resource.state.stages |= next.stages;
+			resource.state.access |= next.access;
+		}
+		else
+		{
+			cmd.barrier( resource.buffer, resource.state, next );
+			resource.state = next;
+		}
+	}
+	// Flush now in case the pass records through get_impl()
+	cmd.flush_barriers();
+	pass.execute( cmd );
+}
+
+renderer::Semaphore renderer::RenderGraph::get_timeline( Queue queue ) const
+{
+	return queue == Queue::GRAPHICS ? *_graphics_timeline : *_compute_timeline;
+}
+
+void renderer::RenderGraph::reset()
+{
+	_textures.clear();
+	_buffers.clear();
+	_texture_outputs.clear();
+	_buffer_outputs.clear();
+	_passes.clear();
+	_segments.clear();
+	_final_segment = -1;
+	_transient_pool.end_frame();
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <functional>
+#include <renderer/barrier.h>
+#include <renderer/buffer.h>
+#include <renderer/common.h>
+#include <renderer/device.h>
+#include <renderer/texture.h>
+#include <renderer/transient_pool.h>
+#include <optional>
+#include <string>
+
+namespace renderer
+{
+	class CommandBuffer;
+
+	// Frame graph built each frame on top of CommandBuffer.
+	// Passes declare how they use textures and buffers, the graph then:
+	// - culls passes that don't contribute to an output (or have side effects)
+	// - orders passes so that producers and consumers are spread apart, giving the GPU independent work to overlap
+	// - records the barriers between passes (texture states are shared with CommandBuffer::use_texture)
+	// - runs passes added on the async compute queue on a second queue, synchronized with timeline semaphores
+	//
+	// Typical frame: acquire swapchain, import resources, add passes, compile(), execute(), submit, reset()
+	class RenderGraph
+	{
+	public:
+		using Queue = Device::Queue;
+		using ExecuteFn = std::function<void( CommandBuffer& cmd )>;
+
+		struct TextureRef
+		{
+			uint32_t index = -1;
+		};
+
+		struct BufferRef
+		{
+			uint32_t index = -1;
+		};
+
+		class PassBuilder
+		{
+		public:
+			// Dependencies are tracked for the whole resource, the subresource range only applies to barriers
+			PassBuilder& use( TextureRef texture, Access access, TextureSubresource range = {} );
+			PassBuilder& use( BufferRef buffer, Access access );
+			// Never cull this pass, for passes writing to something the graph doesn't know about (readbacks, queries...)
+			PassBuilder& set_side_effects();
+
+		private:
+			PassBuilder( RenderGraph& graph, uint32_t pass )
+				: _graph( &graph )
+				, _pass( pass )
+			{
+			}
+
+			RenderGraph* _graph;
+			uint32_t _pass;
+
+			friend class RenderGraph;
+		};
+
+		struct Statistics
+		{
+			uint32_t passes = 0;
+			uint32_t culled_passes = 0;
+			uint32_t async_compute_passes = 0;
+			uint32_t submissions = 0; // Command buffers submitted by the graph itself
+		};
+
+		explicit RenderGraph( Device& device );
+
+		TextureRef import_texture( const Texture& texture );
+		// Buffers don't track their state like textures do, the graph starts from the given access every frame
+		BufferRef import_buffer( const Buffer& buffer, Access initial_access = Access::NONE );
+
+		// Transient resources come from a pool and are only valid for the current frame, starting with undefined content.
+		// Textures with disjoint lifetimes share memory. They are created by compile(), unless all passes using them are culled.
+		TextureRef create_texture( const Texture::Desc& desc );
+		BufferRef create_buffer( Buffer::Usage usage, std::size_t size );
+
+		// Resources are available after compile()
+		const Texture& get_texture( TextureRef texture ) const { return _textures[ texture.index ].texture; }
+		// Only for transient textures, view of all mips
+		TextureView get_texture_view( TextureRef texture ) const;
+		const Buffer& get_buffer( BufferRef buffer ) const { return _buffers[ buffer.index ].buffer; }
+
+		// Passes that don't contribute to an output (directly or not) are culled
+		void set_output( TextureRef texture );
+		void set_output( BufferRef buffer );
+
+		// Passes are executed in an order compatible with their declaration order for the resources they share.
+		// Async compute passes run on the graphics queue if the device doesn't support it.
+		PassBuilder add_pass( std::string name, ExecuteFn execute, Queue queue = Queue::GRAPHICS );
+
+		void compile();
+
+		// Records compiled passes. Passes scheduled before the last graphics segment are recorded in graph owned command buffers
+		// and submitted right away, the remaining ones are recorded in cmd, which must then be submitted with get_final_waits()
+		// and get_final_signals() (next frames wait on those signals).
+		// Limitations:
+		// - Call after Swapchain::acquire() for frame_index, it guarantees graph command buffers of that frame are available
+		// - Commands recorded in cmd before this call execute after the passes submitted by the graph
+		// - Swapchain images should only be used by passes of the last graphics segment, only it waits for acquisition
+		void execute( CommandBuffer& cmd, uint32_t frame_index );
+		// Semaphores to pass to Swapchain::submit() along with cmd
+		std::span<const SemaphoreValue> get_final_waits() const { return _final_waits; }
+		std::span<const SemaphoreValue> get_final_signals() const { return _final_signals; }
+
+		const Statistics& get_statistics() const { return _statistics; }
+		const TransientPool::Statistics& get_transient_statistics() const { return _transient_pool.get_statistics(); }
+
+		// Clears passes and resources, call at the end of the frame
+		void reset();
+
+	private:
+		struct TextureUse
+		{
+			uint32_t texture;
+			Access access;
+			TextureSubresource range;
+		};
+
+		struct BufferUse
+		{
+			uint32_t buffer;
+			Access access;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			ExecuteFn execute;
+			Queue queue;
+			std::vector<TextureUse> textures;
+			std::vector<BufferUse> buffers;
+			bool side_effects = false;
+			bool culled = false;
+			std::vector<uint32_t> dependencies;
+			uint32_t segment = -1;
+		};
+
+		struct TextureResource
+		{
+			Texture texture;
+			std::optional<Texture::Desc> transient_desc;
+			uint32_t transient_index = -1;
+			bool alive = false; // For transient textures, set when recording the first use
+		};
+
+		struct BufferResource
+		{
+			Buffer buffer;
+			AccessInfo state;
+			std::optional<std::pair<Buffer::Usage, std::size_t>> transient_desc;
+			TransientPool::PooledBuffer* pooled = nullptr;
+		};
+
+		// Consecutive passes on the same queue that can be submitted without waiting for the other one
+		struct Segment
+		{
+			Queue queue;
+			std::vector<uint32_t> passes;
+			std::vector<uint32_t> waits; // Segments of the other queue that must complete first
+		};
+
+		void cull_passes();
+		void build_dependencies();
+		std::vector<uint32_t> schedule_passes() const;
+		void build_segments( std::span<const uint32_t> order );
+		void allocate_transients( std::span<const uint32_t> order );
+		void record_pass( CommandBuffer& cmd, const Pass& pass );
+		Semaphore get_timeline( Queue queue ) const;
+
+		Device* _device;
+		TransientPool _transient_pool;
+		std::vector<TextureResource> _textures;
+		std::vector<BufferResource> _buffers;
+		std::vector<uint32_t> _texture_outputs;
+		std::vector<uint32_t> _buffer_outputs;
+		std::vector<Pass> _passes;
+		std::vector<Segment> _segments;
+		uint32_t _final_segment = -1;
+		Statistics _statistics;
+
+		// One timeline per queue, only with async compute support. Values keep increasing across frames.
+		raii::Semaphore _graphics_timeline = nullptr;
+		raii::Semaphore _compute_timeline = nullptr;
+		uint64_t _graphics_value = 0;
+		uint64_t _compute_value = 0;
+		// Last values signaled by each frame in flight, waited before reusing its command buffers
+		std::array<std::array<uint64_t, 2>, MAX_FRAMES_IN_FLIGHT> _frame_values = { };
+		std::array<std::vector<raii::CommandBuffer>, MAX_FRAMES_IN_FLIGHT> _command_buffers;
+		std::vector<SemaphoreValue> _final_waits;
+		std::vector<SemaphoreValue> _final_signals;
+	};
+}
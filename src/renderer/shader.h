@@ -35,6 +35,14 @@ namespace renderer
 		auto operator<=>( const ShaderSource& other ) const = default;
 	};
 
+	// One dimension of a shader permutation matrix, each value is compiled as a separate variant
+	// An empty value means the macro is defined with no value (like #define KEY)
+	struct ShaderDefineAxis
+	{
+		std::string key;
+		std::vector<std::string> values;
+	};
+
 	class PipelineManager;
 	class ShaderCompiler;
 
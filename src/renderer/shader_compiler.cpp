@@ -4,6 +4,7 @@
 #include <fstream>
 #include <renderer/details/profiler.h>
 #include <shaderc/shaderc.hpp>
+#include <spirv-tools/optimizer.hpp>
 
 namespace
 {
@@ -74,21 +75,81 @@ namespace
 				throw renderer::Error( "invalid shader type" );
 		}
 	}
+
+	bool needs_post_process( const renderer::ShaderCompiler::PostProcess& post_process )
+	{
+		return post_process.strip_debug_info || post_process.remap_ids
+			|| post_process.optimization != renderer::ShaderCompiler::PostProcess::Optimization::NONE;
+	}
+
+	std::expected<std::vector<uint32_t>, std::string> post_process_spirv( const renderer::ShaderCompiler::PostProcess& post_process,
+																		  std::span<const uint32_t> words )
+	{
+		OPTICK_EVENT();
+		using Optimization = renderer::ShaderCompiler::PostProcess::Optimization;
+
+		// The optimizer isn't documented as thread safe and compile() is called from TBB jobs, so we build one per module
+		spvtools::Optimizer optimizer( SPV_ENV_VULKAN_1_2 );
+		std::string errors;
+		optimizer.SetMessageConsumer(
+			[ &errors ]( spv_message_level_t level, const char*, const spv_position_t& position, const char* message )
+			{
+				if ( level <= SPV_MSG_ERROR )
+				{
+					errors += std::format( "{}: {}\n", position.index, message );
+				}
+			} );
+
+		if ( post_process.strip_debug_info )
+		{
+			optimizer.RegisterPass( spvtools::CreateStripDebugInfoPass() );
+			optimizer.RegisterPass( spvtools::CreateStripNonSemanticInfoPass() );
+		}
+		switch ( post_process.optimization )
+		{
+			case Optimization::PERFORMANCE:
+				optimizer.RegisterPerformancePasses();
+				break;
+			case Optimization::SIZE:
+				optimizer.RegisterSizePasses();
+				break;
+			case Optimization::NONE:
+				break;
+		}
+		if ( post_process.remap_ids )
+		{
+			optimizer.RegisterPass( spvtools::CreateCompactIdsPass() );
+		}
+
+		std::vector<uint32_t> result;
+		if ( !optimizer.Run( words.data(), words.size(), &result ) )
+		{
+			return std::unexpected( "SPIR-V post processing failed: " + errors );
+		}
+		return result;
+	}
 }
 
 struct renderer::ShaderCompiler::Impl
 {
-	explicit Impl( std::filesystem::path dir )
+	Impl( std::filesystem::path dir, const PostProcess& post )
 		: base_dir( std::move( dir ) )
+		, post_process( post )
 	{
 	}
 
 	shaderc::Compiler compiler;
 	std::filesystem::path base_dir;
+	PostProcess post_process;
 };
 
 renderer::ShaderCompiler::ShaderCompiler( std::filesystem::path base_dir )
-	: _impl( std::make_unique<Impl>( std::move( base_dir ) ) )
+	: ShaderCompiler( std::move( base_dir ), PostProcess {} )
+{
+}
+
+renderer::ShaderCompiler::ShaderCompiler( std::filesystem::path base_dir, const PostProcess& post_process )
+	: _impl( std::make_unique<Impl>( std::move( base_dir ), post_process ) )
 {
 }
 
@@ -139,6 +200,16 @@ std::expected<renderer::raii::ShaderCode, std::string> renderer::ShaderCompiler:
 		return std::unexpected( result.GetErrorMessage() );
 	}
 
+	if ( needs_post_process( _impl->post_process ) )
+	{
+		auto processed = post_process_spirv( _impl->post_process, std::span( result.begin(), result.end() ) );
+		if ( !processed )
+		{
+			return std::unexpected( std::move( processed.error() ) );
+		}
+		return raii::ShaderCode( std::move( source ), std::move( processed.value() ) );
+	}
+
 	// Hiding away shaderc means we need to make a copy since it doesn't provide a way to take ownership of the data
 	// If this proves to be a serious hindrance we could replace the vector with a type erased shaderc_compilation_result_t
 	return raii::ShaderCode( std::move( source ), std::vector<uint32_t>( result.begin(), result.end() ) );
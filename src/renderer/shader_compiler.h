@@ -12,7 +12,30 @@ namespace renderer
 	class ShaderCompiler
 	{
 	public:
+		// Optional SPIR-V processing applied on top of shaderc's output before handing out the code
+		struct PostProcess
+		{
+			enum class Optimization
+			{
+				NONE,
+				PERFORMANCE,
+				SIZE
+			};
+
+			// Strip debug names, line info and non-semantic/reflection instructions
+#ifdef _DEBUG
+			bool strip_debug_info = false;
+#else
+			bool strip_debug_info = true;
+#endif
+			// Extra optimizer passes run on the final module, after stripping so they can take advantage of it
+			Optimization optimization = Optimization::NONE;
+			// Renumber ids densely in order of appearance, makes modules compress better and identical code produce identical bytes
+			bool remap_ids = false;
+		};
+
 		explicit ShaderCompiler( std::filesystem::path base_dir );
+		ShaderCompiler( std::filesystem::path base_dir, const PostProcess& post_process );
 		~ShaderCompiler();
 
 		const std::filesystem::path& get_base_directory() const;
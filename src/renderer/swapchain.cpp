@@ -1,7 +1,9 @@
 #include "swapchain.h"
 
 #include <VkBootstrap.h>
+#include <algorithm>
 #include <ranges>
+#include <renderer/barrier.h>
 #include <renderer/command_buffer.h>
 #include <renderer/details/profiler.h>
 #include <renderer/device.h>
@@ -100,26 +102,44 @@ std::tuple<uint32_t, renderer::Texture, renderer::TextureView> renderer::Swapcha
 		throw Error( "Failed to acquire swapchain image", result );
 	}
 	_current_image = image_index;
+
+	// Content doesn't survive presentation. Starting from the acquire semaphore wait stage makes sure the layout transition
+	// of the first use happens after the image is actually available.
+	std::ranges::fill( _images[ image_index ]._state->mips,
+					   AccessInfo { .stages = vk::PipelineStageFlagBits2::eColorAttachmentOutput, .layout = Texture::Layout::UNDEFINED } );
 	return { frame_index, _images[ image_index ], _image_views[ image_index ] };
 }
 
-void renderer::Swapchain::submit( CommandBuffer& buffer )
+void renderer::Swapchain::submit( CommandBuffer& buffer, std::span<const SemaphoreValue> waits, std::span<const SemaphoreValue> signals )
 {
 	const auto frame_index = _frame_count % MAX_FRAMES_IN_FLIGHT;
 	const vk::CommandBufferSubmitInfo cmd_submit_info { .commandBuffer = buffer._cmd_buffer };
-	const vk::SemaphoreSubmitInfo wait_info { .semaphore = _acquire_semaphores[ frame_index ],
-											  .value = 1,
-											  .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput };
-	const vk::SemaphoreSubmitInfo signal_info { .semaphore = _submit_semaphores[ _current_image ],
-												.value = 1,
-												.stageMask = vk::PipelineStageFlagBits2::eAllGraphics };
-
-	_device->_gfx_queue.submit2( vk::SubmitInfo2 { .waitSemaphoreInfoCount = 1,
-												   .pWaitSemaphoreInfos = &wait_info,
+	std::vector<vk::SemaphoreSubmitInfo> wait_infos;
+	wait_infos.reserve( waits.size() + 1 );
+	wait_infos.push_back( { .semaphore = _acquire_semaphores[ frame_index ],
+							.value = 1,
+							.stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput } );
+	for ( const auto& wait : waits )
+	{
+		wait_infos.push_back(
+			{ .semaphore = wait.semaphore, .value = wait.value, .stageMask = vk::PipelineStageFlagBits2::eAllCommands } );
+	}
+	std::vector<vk::SemaphoreSubmitInfo> signal_infos;
+	signal_infos.reserve( signals.size() + 1 );
+	signal_infos.push_back(
+		{ .semaphore = _submit_semaphores[ _current_image ], .value = 1, .stageMask = vk::PipelineStageFlagBits2::eAllGraphics } );
+	for ( const auto& signal : signals )
+	{
+		signal_infos.push_back(
+			{ .semaphore = signal.semaphore, .value = signal.value, .stageMask = vk::PipelineStageFlagBits2::eAllCommands } );
+	}
+
+	_device->_gfx_queue.submit2( vk::SubmitInfo2 { .waitSemaphoreInfoCount = static_cast<uint32_t>( wait_infos.size() ),
+												   .pWaitSemaphoreInfos = wait_infos.data(),
 												   .commandBufferInfoCount = 1,
 												   .pCommandBufferInfos = &cmd_submit_info,
-												   .signalSemaphoreInfoCount = 1,
-												   .pSignalSemaphoreInfos = &signal_info },
+												   .signalSemaphoreInfoCount = static_cast<uint32_t>( signal_infos.size() ),
+												   .pSignalSemaphoreInfos = signal_infos.data() },
 								 _frame_fences[ frame_index ] );
 }
 
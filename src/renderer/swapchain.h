@@ -3,6 +3,7 @@
 #include <array>
 #include <renderer/common.h>
 #include <renderer/texture.h>
+#include <span>
 
 namespace renderer
 {
@@ -18,7 +19,9 @@ namespace renderer
 		uint32_t get_image_count() const { return _images.size(); }
 
 		std::tuple<uint32_t, Texture, TextureView> acquire();
-		void submit( CommandBuffer& buffer );
+		// Extra waits and signals on timeline semaphores (eg: async compute work from a render graph)
+		// Waits block all stages of the frame command buffer
+		void submit( CommandBuffer& buffer, std::span<const SemaphoreValue> waits = { }, std::span<const SemaphoreValue> signals = { } );
 		void present();
 
 		void recreate( Texture::Format format, bool vsync = true );
@@ -1,19 +1,84 @@
 #include "texture.h"
 
+#include <algorithm>
+#include <renderer/barrier.h>
+
+renderer::Texture::Texture( vk::Image image, const Desc& desc )
+	: _image( image )
+	, _desc( desc )
+	, _state( std::make_shared<details::TextureState>(
+		  std::vector<AccessInfo>( desc.mips, get_access_info( Access::NONE ) ) ) )
+{
+}
+
+std::size_t renderer::Texture::get_mip_size( const Desc& desc, int mip )
+{
+	const auto block = get_block_info( desc.format );
+	const std::size_t height = std::max( desc.extent.height >> mip, 1u );
+	const std::size_t depth = std::max( desc.depth >> mip, 1 );
+	return get_row_pitch( desc, mip ) * ( ( height + block.height - 1 ) / block.height ) * depth * desc.layers;
+}
+
+std::size_t renderer::Texture::get_row_pitch( const Desc& desc, int mip )
+{
+	const auto block = get_block_info( desc.format );
+	const std::size_t width = std::max( desc.extent.width >> mip, 1u );
+	return ( width + block.width - 1 ) / block.width * block.size;
+}
+
 std::size_t renderer::Texture::get_bpp( Format format )
+{
+	const auto block = get_block_info( format );
+	return block.width == 1 ? block.size : 0;
+}
+
+renderer::Texture::BlockInfo renderer::Texture::get_block_info( Format format )
 {
 	switch ( format )
 	{
-		break;
 		case renderer::Texture::Format::R8G8B8A8_UNORM:
 		case renderer::Texture::Format::R8G8B8A8_SRGB:
 		case renderer::Texture::Format::R32_SFLOAT:
 		case renderer::Texture::Format::D32_SFLOAT:
-			return 4;
+			return { .size = 4 };
 		case renderer::Texture::Format::R16G16B16A16_SFLOAT:
-			return 8;
+			return { .size = 8 };
+		case renderer::Texture::Format::BC1_RGBA_UNORM:
+		case renderer::Texture::Format::BC1_RGBA_SRGB:
+		case renderer::Texture::Format::BC4_UNORM:
+		case renderer::Texture::Format::BC4_SNORM:
+			return { .width = 4, .height = 4, .size = 8 };
+		case renderer::Texture::Format::BC2_UNORM:
+		case renderer::Texture::Format::BC2_SRGB:
+		case renderer::Texture::Format::BC3_UNORM:
+		case renderer::Texture::Format::BC3_SRGB:
+		case renderer::Texture::Format::BC5_UNORM:
+		case renderer::Texture::Format::BC5_SNORM:
+		case renderer::Texture::Format::BC6H_UFLOAT:
+		case renderer::Texture::Format::BC6H_SFLOAT:
+		case renderer::Texture::Format::BC7_UNORM:
+		case renderer::Texture::Format::BC7_SRGB:
+		case renderer::Texture::Format::ETC2_R8G8B8A8_UNORM:
+		case renderer::Texture::Format::ETC2_R8G8B8A8_SRGB:
+		case renderer::Texture::Format::ASTC_4x4_UNORM:
+		case renderer::Texture::Format::ASTC_4x4_SRGB:
+			return { .width = 4, .height = 4, .size = 16 };
 		case renderer::Texture::Format::UNDEFINED:
 		default:
-			return 0;
+			return { };
+	}
+}
+
+renderer::TextureView::Type renderer::TextureView::get_default_type( const Texture& texture )
+{
+	switch ( texture.get_type() )
+	{
+		case Texture::Type::TEXTURE_3D:
+			return Type::TEXTURE_3D;
+		case Texture::Type::CUBE:
+			return texture.get_layers() > 6 ? Type::CUBE_ARRAY : Type::CUBE;
+		case Texture::Type::TEXTURE_2D:
+		default:
+			return texture.get_layers() > 1 ? Type::TEXTURE_2D_ARRAY : Type::TEXTURE_2D;
 	}
 }
@@ -8,6 +8,11 @@ namespace renderer
 	class Device;
 	class Swapchain;
 
+	namespace details
+	{
+		struct TextureState;
+	}
+
 	namespace raii
 	{
 		class Texture;
@@ -24,7 +29,26 @@ namespace renderer
 			R8G8B8A8_SRGB = std::to_underlying( vk::Format::eR8G8B8A8Srgb ),
 			R16G16B16A16_SFLOAT = std::to_underlying( vk::Format::eR16G16B16A16Sfloat ),
 			R32_SFLOAT = std::to_underlying( vk::Format::eR32Sfloat ),
-			D32_SFLOAT = std::to_underlying( vk::Format::eD32Sfloat )
+			D32_SFLOAT = std::to_underlying( vk::Format::eD32Sfloat ),
+			// Block compressed, need the matching Device::Properties::*_compression_support
+			BC1_RGBA_UNORM = std::to_underlying( vk::Format::eBc1RgbaUnormBlock ),
+			BC1_RGBA_SRGB = std::to_underlying( vk::Format::eBc1RgbaSrgbBlock ),
+			BC2_UNORM = std::to_underlying( vk::Format::eBc2UnormBlock ),
+			BC2_SRGB = std::to_underlying( vk::Format::eBc2SrgbBlock ),
+			BC3_UNORM = std::to_underlying( vk::Format::eBc3UnormBlock ),
+			BC3_SRGB = std::to_underlying( vk::Format::eBc3SrgbBlock ),
+			BC4_UNORM = std::to_underlying( vk::Format::eBc4UnormBlock ),
+			BC4_SNORM = std::to_underlying( vk::Format::eBc4SnormBlock ),
+			BC5_UNORM = std::to_underlying( vk::Format::eBc5UnormBlock ),
+			BC5_SNORM = std::to_underlying( vk::Format::eBc5SnormBlock ),
+			BC6H_UFLOAT = std::to_underlying( vk::Format::eBc6HUfloatBlock ),
+			BC6H_SFLOAT = std::to_underlying( vk::Format::eBc6HSfloatBlock ),
+			BC7_UNORM = std::to_underlying( vk::Format::eBc7UnormBlock ),
+			BC7_SRGB = std::to_underlying( vk::Format::eBc7SrgbBlock ),
+			ETC2_R8G8B8A8_UNORM = std::to_underlying( vk::Format::eEtc2R8G8B8A8UnormBlock ),
+			ETC2_R8G8B8A8_SRGB = std::to_underlying( vk::Format::eEtc2R8G8B8A8SrgbBlock ),
+			ASTC_4x4_UNORM = std::to_underlying( vk::Format::eAstc4x4UnormBlock ),
+			ASTC_4x4_SRGB = std::to_underlying( vk::Format::eAstc4x4SrgbBlock )
 		};
 
 		enum class Layout : std::underlying_type_t<vk::ImageLayout>
@@ -51,6 +75,21 @@ namespace renderer
 			DEPTH_STENCIL_ATTACHMENT = std::to_underlying( vk::ImageUsageFlagBits::eDepthStencilAttachment )
 		};
 
+		enum class Type
+		{
+			TEXTURE_2D, // Arrays when layers > 1
+			TEXTURE_3D,
+			CUBE // 6 layers per cube, cube arrays when layers > 6
+		};
+
+		// Compressed formats store blocks of texels, uncompressed ones are 1x1 blocks
+		struct BlockInfo
+		{
+			uint32_t width = 1;
+			uint32_t height = 1;
+			std::size_t size = 0; // Bytes
+		};
+
 		struct Desc
 		{
 			Format format = Format::UNDEFINED;
@@ -58,6 +97,11 @@ namespace renderer
 			Extent2D extent;
 			int mips = 1;
 			int samples = 1;
+			Type type = Type::TEXTURE_2D;
+			int layers = 1;
+			int depth = 1; // 3D textures only
+
+			bool operator==( const Desc& other ) const = default;
 		};
 
 		Texture() = default;
@@ -67,27 +111,40 @@ namespace renderer
 		Extent2D get_extent() const { return _desc.extent; }
 		int get_mips() const { return _desc.mips; }
 		int get_samples() const { return _desc.samples; }
-
-		std::size_t get_size() const { return _desc.extent.width * _desc.extent.height * get_bpp( _desc.format ); }
-
+		Type get_type() const { return _desc.type; }
+		int get_layers() const { return _desc.layers; }
+		int get_depth() const { return _desc.depth; }
+
+		// All sizes are block aware, rows are made of whole blocks
+		std::size_t get_size() const { return get_mip_size( 0 ); }
+		// Tightly packed with all layers and depth slices, as expected by CommandBuffer::copy_buffer_to_texture()
+		std::size_t get_mip_size( int mip ) const { return get_mip_size( _desc, mip ); }
+		std::size_t get_row_pitch( int mip ) const { return get_row_pitch( _desc, mip ); }
+		static std::size_t get_mip_size( const Desc& desc, int mip );
+		static std::size_t get_row_pitch( const Desc& desc, int mip );
+
+		// Bytes per texel of uncompressed formats, 0 for block compressed ones
 		static std::size_t get_bpp( Format format );
+		static BlockInfo get_block_info( Format format );
+		static bool is_compressed( Format format ) { return get_block_info( format ).width > 1; }
 
 	protected:
 		vk::Image get_image() const { return _image; }
 
-		Texture( vk::Image image, const Desc& desc )
-			: _image( image )
-			, _desc( desc )
-		{
-		}
+		// Starts tracking the texture layout and accesses, see CommandBuffer::use_texture()
+		Texture( vk::Image image, const Desc& desc );
 
 	private:
 		vk::Image _image;
 		Desc _desc;
+		// Shared by all copies of the texture
+		std::shared_ptr<details::TextureState> _state;
 
+		friend class BindlessManagerBase;
 		friend class CommandBuffer;
 		friend class Device;
 		friend class Swapchain;
+		friend class TransientPool;
 	};
 
 	inline constexpr Texture::Usage operator|( Texture::Usage lhs, Texture::Usage rhs )
@@ -109,6 +166,19 @@ namespace renderer
 			DEPTH = std::to_underlying( vk::ImageAspectFlagBits::eDepth )
 		};
 
+		enum class Type : std::underlying_type_t<vk::ImageViewType>
+		{
+			TEXTURE_2D = std::to_underlying( vk::ImageViewType::e2D ),
+			TEXTURE_2D_ARRAY = std::to_underlying( vk::ImageViewType::e2DArray ),
+			TEXTURE_3D = std::to_underlying( vk::ImageViewType::e3D ),
+			CUBE = std::to_underlying( vk::ImageViewType::eCube ),
+			CUBE_ARRAY = std::to_underlying( vk::ImageViewType::eCubeArray )
+		};
+
+		// All layers of the texture: 2D arrays for layered 2D textures, cube arrays for more than one cube (see
+		// Device::Properties::cube_array_support)
+		static Type get_default_type( const Texture& texture );
+
 		// private:
 		vk::ImageView _view;
 
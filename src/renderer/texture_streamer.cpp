@@ -0,0 +1,276 @@
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <renderer/details/profiler.h>
+#include <renderer/device.h>
+#include <renderer/upload_manager.h>
+
+namespace
+{
+	// Cleared feedback value, the texture wasn't sampled
+	constexpr int32_t NO_REQUEST = std::numeric_limits<int32_t>::max();
+
+	// Shaders writing feedback may be anywhere in the frame
+	const renderer::AccessInfo FEEDBACK_ACCESS { .stages = vk::PipelineStageFlagBits2::eAllGraphics
+													 | vk::PipelineStageFlagBits2::eComputeShader,
+												 .access = vk::AccessFlagBits2::eShaderStorageRead
+													 | vk::AccessFlagBits2::eShaderStorageWrite };
+}
+
+renderer::TextureStreamer::TextureStreamer( Device& device,
+											BindlessManagerBase& bindless_manager,
+											UploadManager& uploader,
+											const Desc& desc )
+	: _device( &device )
+	, _bindless_manager( &bindless_manager )
+	, _uploader( &uploader )
+	, _desc( desc )
+{
+	for ( auto& frame : _frames )
+	{
+		frame.feedback = device.create_readback_buffer(
+			Buffer::Usage::STORAGE_BUFFER | Buffer::Usage::SHADER_DEVICE_ADDRESS | Buffer::Usage::TRANSFER_DST,
+			desc.max_textures * sizeof( int32_t ) );
+		frame.texture_table = device.create_buffer( Buffer::Usage::STORAGE_BUFFER | Buffer::Usage::SHADER_DEVICE_ADDRESS,
+													desc.max_textures * sizeof( uint32_t ),
+													true );
+	}
+}
+
+renderer::TextureStreamer::Handle renderer::TextureStreamer::add_texture( std::vector<std::byte> ktx2_data )
+{
+	OPTICK_EVENT();
+	if ( _textures.size() >= _desc.max_textures )
+	{
+		throw Error( "Too many streamed textures" );
+	}
+
+	// Mips point into the data, its heap storage doesn't move with the vector
+	StreamedTexture streamed { .data = std::move( ktx2_data ) };
+	streamed.image = parse_ktx2( streamed.data );
+	auto& desc = streamed.image.desc;
+	if ( !_device->is_format_supported( desc.format ) )
+	{
+		throw Error( "KTX2 texture format not supported by the device" );
+	}
+	desc.usage = Texture::Usage::SAMPLED | Texture::Usage::TRANSFER_DST;
+
+	while ( streamed.min_mip < desc.mips - 1
+			&& std::max( desc.extent.width >> streamed.min_mip, desc.extent.height >> streamed.min_mip ) > _desc.min_resident_extent )
+	{
+		++streamed.min_mip;
+	}
+	streamed.resident_mip = streamed.min_mip;
+	streamed.desired_mip = streamed.min_mip;
+	streamed.texture = _bindless_manager->add_texture( create_texture( streamed, streamed.min_mip ) );
+
+	// No frame in flight reads that entry yet, so every table can have it right away
+	const Handle handle { .index = static_cast<uint32_t>( _textures.size() ) };
+	for ( auto& frame : _frames )
+	{
+		static_cast<uint32_t*>( frame.texture_table.get_mapped_address() )[ handle.index ] = streamed.texture.handles.texture_index;
+	}
+	_statistics.resident_memory += get_memory_size( streamed, streamed.resident_mip );
+	_textures.push_back( std::move( streamed ) );
+	_statistics.textures = _textures.size();
+	return handle;
+}
+
+renderer::TextureStreamer::Handle renderer::TextureStreamer::add_texture( const std::filesystem::path& path )
+{
+	std::ifstream istream( path, std::ios::binary );
+	if ( !istream )
+	{
+		throw Error( std::format( "Couldn't open texture file '{}'", path.string() ) );
+	}
+	const std::vector<char> content { std::istreambuf_iterator<char>( istream ), std::istreambuf_iterator<char>() };
+	const auto bytes = std::as_bytes( std::span( content ) );
+	return add_texture( std::vector<std::byte>( begin( bytes ), end( bytes ) ) );
+}
+
+void renderer::TextureStreamer::begin_frame( CommandBuffer& cmd, uint32_t frame_index )
+{
+	OPTICK_EVENT();
+	auto& frame = _frames[ frame_index ];
+	swap_uploaded_textures();
+	read_feedback( frame );
+	fit_budget();
+
+	// Downgrades first, they free memory and their uploads are small
+	// Textures still waiting for an upload are left alone until it lands
+	_statistics.uploaded_last_frame = 0;
+	std::vector<StreamedTexture*> upgrades;
+	for ( auto& texture : _textures )
+	{
+		if ( texture.pending )
+		{
+			continue;
+		}
+		if ( texture.desired_mip > texture.resident_mip )
+		{
+			set_resident_mip( texture, texture.desired_mip );
+			++_statistics.downgrades;
+		}
+		else if ( texture.desired_mip < texture.resident_mip )
+		{
+			upgrades.push_back( &texture );
+		}
+	}
+
+	// Then the most recently requested textures, as long as the upload budget allows. At least one per frame so that
+	// textures bigger than the budget still make it.
+	std::ranges::stable_sort( upgrades, std::greater {}, &StreamedTexture::last_requested );
+	std::size_t uploaded = 0;
+	for ( auto texture : upgrades )
+	{
+		const auto size = get_memory_size( *texture, texture->desired_mip );
+		if ( uploaded > 0 && uploaded + size > _desc.upload_budget_per_frame )
+		{
+			break;
+		}
+		set_resident_mip( *texture, texture->desired_mip );
+		uploaded += size;
+		++_statistics.upgrades;
+	}
+
+	_statistics.resident_memory = 0;
+	frame.resident_mips.resize( _textures.size() );
+	const auto table = static_cast<uint32_t*>( frame.texture_table.get_mapped_address() );
+	for ( uint32_t index = 0; index < _textures.size(); ++index )
+	{
+		_statistics.resident_memory += get_memory_size( _textures[ index ], _textures[ index ].resident_mip );
+		frame.resident_mips[ index ] = _textures[ index ].resident_mip;
+		table[ index ] = _textures[ index ].texture.handles.texture_index;
+	}
+
+	cmd.fill_buffer( frame.feedback, 0, frame.feedback.get_size(), static_cast<uint32_t>( NO_REQUEST ) );
+	cmd.barrier( frame.feedback, get_access_info( Access::TRANSFER_WRITE ), FEEDBACK_ACCESS );
+	++_frame_count;
+}
+
+void renderer::TextureStreamer::end_frame( CommandBuffer& cmd, uint32_t frame_index )
+{
+	auto& frame = _frames[ frame_index ];
+	cmd.barrier( frame.feedback,
+				 FEEDBACK_ACCESS,
+				 AccessInfo { .stages = vk::PipelineStageFlagBits2::eHost, .access = vk::AccessFlagBits2::eHostRead } );
+	frame.written = true;
+}
+
+std::size_t renderer::TextureStreamer::get_memory_size( const StreamedTexture& texture, int first_mip )
+{
+	std::size_t size = 0;
+	for ( int mip = first_mip; mip < texture.image.desc.mips; ++mip )
+	{
+		size += Texture::get_mip_size( texture.image.desc, mip );
+	}
+	return size;
+}
+
+renderer::raii::Texture renderer::TextureStreamer::create_texture( const StreamedTexture& texture, int first_mip )
+{
+	auto desc = texture.image.desc;
+	desc.extent = { .width = std::max( desc.extent.width >> first_mip, 1u ), .height = std::max( desc.extent.height >> first_mip, 1u ) };
+	desc.depth = std::max( desc.depth >> first_mip, 1 );
+	desc.mips -= first_mip;
+	auto resident = _device->create_texture( desc );
+	const auto mips = std::span( texture.image.mips ).subspan( first_mip );
+	_uploader->upload( resident, 0, mips );
+	for ( const auto& mip : mips )
+	{
+		_statistics.uploaded_last_frame += mip.size();
+	}
+	return resident;
+}
+
+void renderer::TextureStreamer::read_feedback( Frame& frame )
+{
+	if ( !frame.written )
+	{
+		return;
+	}
+	OPTICK_EVENT();
+
+	frame.feedback.invalidate();
+	const auto requests = static_cast<const int32_t*>( frame.feedback.get_mapped_address() );
+	for ( uint32_t index = 0; index < frame.resident_mips.size(); ++index )
+	{
+		auto& texture = _textures[ index ];
+		if ( requests[ index ] == NO_REQUEST )
+		{
+			// Not sampled, keep what we have unless the budget needs it
+			texture.desired_mip = texture.resident_mip;
+			continue;
+		}
+		texture.desired_mip = std::clamp( frame.resident_mips[ index ] + requests[ index ], 0, texture.min_mip );
+		texture.last_requested = _frame_count;
+	}
+}
+
+void renderer::TextureStreamer::fit_budget()
+{
+	std::size_t total = 0;
+	for ( const auto& texture : _textures )
+	{
+		total += get_memory_size( texture, texture.desired_mip );
+	}
+	if ( total <= _desc.memory_budget )
+	{
+		return;
+	}
+
+	// Least recently requested first, bigger ones first among them
+	std::vector<StreamedTexture*> candidates;
+	candidates.reserve( _textures.size() );
+	for ( auto& texture : _textures )
+	{
+		candidates.push_back( &texture );
+	}
+	std::ranges::sort( candidates,
+					   [ & ]( const StreamedTexture* lhs, const StreamedTexture* rhs )
+					   {
+						   if ( lhs->last_requested != rhs->last_requested )
+						   {
+							   return lhs->last_requested < rhs->last_requested;
+						   }
+						   return get_memory_size( *lhs, lhs->desired_mip ) > get_memory_size( *rhs, rhs->desired_mip );
+					   } );
+
+	for ( auto texture : candidates )
+	{
+		while ( total > _desc.memory_budget && texture->desired_mip < texture->min_mip )
+		{
+			total -= Texture::get_mip_size( texture->image.desc, texture->desired_mip );
+			++texture->desired_mip;
+		}
+		if ( total <= _desc.memory_budget )
+		{
+			break;
+		}
+	}
+}
+
+void renderer::TextureStreamer::set_resident_mip( StreamedTexture& texture, int mip )
+{
+	// New indices, descriptors that frames in flight read are never rewritten
+	auto bindless = _bindless_manager->add_texture( create_texture( texture, mip ) );
+	texture.pending = PendingTexture { .texture = std::move( bindless ), .mip = mip, .upload_batch = _uploader->get_pending_batch() };
+}
+
+void renderer::TextureStreamer::swap_uploaded_textures()
+{
+	for ( auto& texture : _textures )
+	{
+		if ( texture.pending && _uploader->is_complete( texture.pending->upload_batch ) )
+		{
+			// The previous texture is destroyed once frames that may still use it are done
+			_bindless_manager->remove_texture( texture.texture );
+			texture.texture = std::move( texture.pending->texture );
+			texture.resident_mip = texture.pending->mip;
+			texture.pending.reset();
+		}
+	}
+}
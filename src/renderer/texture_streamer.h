@@ -0,0 +1,124 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <renderer/bindless.h>
+#include <renderer/buffer.h>
+#include <renderer/command_buffer.h>
+#include <renderer/common.h>
+#include <renderer/ktx.h>
+#include <renderer/texture.h>
+
+namespace renderer
+{
+	class Device;
+	class UploadManager;
+
+	// Streams mips of KTX2 textures in and out of VRAM. Only the small mips are loaded at first, then each texture
+	// gets the mips shaders ask for as long as everything fits in the memory budget. When it doesn't, the least
+	// recently requested textures are downgraded first.
+	// Residency changes register the new mips as a new bindless texture, which replaces the previous one once its upload
+	// has completed. Frames in flight keep sampling the previous one until it is removed.
+	//
+	// Shaders find the current bindless index of each texture in a per-frame table of uints and report the mip they need
+	// in a per-frame feedback buffer of ints, both indexed by Handle::index, with something like:
+	//   const uint texture_index = texture_table[ handle_index ];
+	//   atomicMin( feedback[ handle_index ], int( floor( textureQueryLod( sampler2D( ... ), uv ).x ) ) );
+	// The LOD is relative to the resident texture and can be negative, the streamer takes care of the offset.
+	class TextureStreamer
+	{
+	public:
+		struct Desc
+		{
+			std::size_t memory_budget = 512 * 1024 * 1024;
+			// Mips bigger than the ones uploaded up to that limit wait for the next frame
+			std::size_t upload_budget_per_frame = 16 * 1024 * 1024;
+			uint32_t max_textures = 4096;
+			// Mips at least that small are always resident
+			uint32_t min_resident_extent = 64;
+		};
+
+		struct Handle
+		{
+			uint32_t index; // In the texture table and feedback buffer
+		};
+
+		struct Statistics
+		{
+			std::size_t resident_memory = 0;
+			std::size_t uploaded_last_frame = 0;
+			uint32_t textures = 0;
+			uint32_t upgrades = 0;
+			uint32_t downgrades = 0;
+		};
+
+		TextureStreamer( Device& device, BindlessManagerBase& bindless_manager, UploadManager& uploader, const Desc& desc );
+
+		// The file content is kept in memory to stream mips later. The handle is in the texture table of every frame
+		// index right away, it can be used in the frame being recorded.
+		Handle add_texture( std::vector<std::byte> ktx2_data );
+		Handle add_texture( const std::filesystem::path& path );
+
+		// Shaders of the frame write to that buffer (needs a device address)
+		Buffer get_feedback_buffer( uint32_t frame_index ) const { return _frames[ frame_index ].feedback; }
+		// Bindless texture index of each texture for the frame (needs a device address)
+		Buffer get_texture_table( uint32_t frame_index ) const { return _frames[ frame_index ].texture_table; }
+
+		// Call before recording the frame, once its previous use with the same index has completed. Reads back the
+		// feedback of that previous use, updates residency (with uploads, flush the UploadManager before submitting),
+		// fills the texture table and clears the feedback buffer.
+		void begin_frame( CommandBuffer& cmd, uint32_t frame_index );
+		// Call after the last shader writing feedback, makes it visible to the host
+		void end_frame( CommandBuffer& cmd, uint32_t frame_index );
+
+		const Statistics& get_statistics() const { return _statistics; }
+
+	private:
+		struct PendingTexture
+		{
+			BindlessTexture texture;
+			int mip = 0;
+			uint64_t upload_batch = 0; // See UploadManager::is_complete()
+		};
+
+		struct StreamedTexture
+		{
+			std::vector<std::byte> data;
+			Ktx2Image image;
+			BindlessTexture texture;
+			// Next residency, waiting for its upload
+			std::optional<PendingTexture> pending;
+			int resident_mip = 0;
+			int min_mip = 0; // Lowest quality mip, always resident
+			int desired_mip = 0;
+			uint64_t last_requested = 0;
+		};
+
+		struct Frame
+		{
+			raii::Buffer feedback;
+			raii::Buffer texture_table;
+			// Resident mips when the feedback was written, requested LODs are relative to them
+			std::vector<int> resident_mips;
+			bool written = false;
+		};
+
+		static std::size_t get_memory_size( const StreamedTexture& texture, int first_mip );
+		// Texture with mips from first_mip to the last, queued for upload
+		raii::Texture create_texture( const StreamedTexture& texture, int first_mip );
+		void read_feedback( Frame& frame );
+		void fit_budget();
+		// Uploads the mips in a new texture, used once the upload completes (see swap_uploaded_textures())
+		void set_resident_mip( StreamedTexture& texture, int mip );
+		void swap_uploaded_textures();
+
+		Device* _device;
+		BindlessManagerBase* _bindless_manager;
+		UploadManager* _uploader;
+		Desc _desc;
+		std::vector<StreamedTexture> _textures;
+		std::array<Frame, MAX_FRAMES_IN_FLIGHT> _frames;
+		uint64_t _frame_count = 0;
+		Statistics _statistics;
+	};
+}
@@ -0,0 +1,249 @@
+#include "transient_pool.h"
+
+#include <algorithm>
+#include <numeric>
+#include <renderer/details/profiler.h>
+#include <renderer/device.h>
+
+namespace
+{
+	// Buffers not acquired for that many frames are released
+	constexpr uint32_t BUFFER_RELEASE_DELAY = 8;
+
+	std::size_t align_up( std::size_t value, std::size_t alignment ) { return ( value + alignment - 1 ) / alignment * alignment; }
+}
+
+renderer::TransientPool::TransientPool( Device& device )
+	: _device( &device )
+{
+}
+
+std::span<const renderer::Texture> renderer::TransientPool::allocate_textures( std::span<const TextureRequest> requests )
+{
+	if ( std::ranges::equal( requests, _requests ) )
+	{
+		return _textures;
+	}
+	OPTICK_EVENT();
+
+	struct Item
+	{
+		vk::MemoryRequirements requirements;
+		uint32_t heap = 0;
+		std::size_t offset = 0;
+	};
+	std::vector<Item> items( requests.size() );
+	for ( uint32_t index = 0; index < requests.size(); ++index )
+	{
+		items[ index ].requirements = _device->get_memory_requirements( requests[ index ].desc );
+	}
+
+	// One heap per set of compatible memory types, in practice render targets all end up in the same one
+	std::vector<Heap> heaps;
+	std::vector<std::size_t> heap_alignments;
+	for ( auto& item : items )
+	{
+		const auto it = std::ranges::find( heaps, item.requirements.memoryTypeBits, &Heap::memory_type_bits );
+		item.heap = it - begin( heaps );
+		if ( it == end( heaps ) )
+		{
+			heaps.push_back( Heap { .memory_type_bits = item.requirements.memoryTypeBits } );
+			heap_alignments.push_back( 1 );
+		}
+		heap_alignments[ item.heap ] = std::max<std::size_t>( heap_alignments[ item.heap ], item.requirements.alignment );
+	}
+
+	// Biggest first, each texture goes at the lowest offset that doesn't overlap textures alive at the same time
+	std::vector<uint32_t> sorted( items.size() );
+	std::iota( begin( sorted ), end( sorted ), 0 );
+	std::ranges::stable_sort( sorted, std::greater { }, [ & ]( auto index ) { return items[ index ].requirements.size; } );
+	std::vector<std::vector<uint32_t>> placed( heaps.size() );
+	for ( auto index : sorted )
+	{
+		auto& item = items[ index ];
+		const auto& request = requests[ index ];
+		bool moved = true;
+		while ( moved )
+		{
+			moved = false;
+			for ( auto other_index : placed[ item.heap ] )
+			{
+				const auto& other = items[ other_index ];
+				const auto& other_request = requests[ other_index ];
+				const bool alive_together = request.first_use <= other_request.last_use && other_request.first_use <= request.last_use;
+				const auto other_end = other.offset + other.requirements.size;
+				if ( alive_together && item.offset < other_end && other.offset < item.offset + item.requirements.size )
+				{
+					item.offset = align_up( other_end, item.requirements.alignment );
+					moved = true;
+				}
+			}
+		}
+		placed[ item.heap ].push_back( index );
+		auto& heap = heaps[ item.heap ];
+		heap.size = std::max( heap.size, item.offset + item.requirements.size );
+	}
+
+	// Keep previous heaps that are big enough, textures placed in them may be reused too
+	for ( uint32_t index = 0; index < heaps.size(); ++index )
+	{
+		auto& heap = heaps[ index ];
+		const auto it = std::ranges::find_if( _heaps,
+											  [ & ]( const Heap& previous )
+											  {
+												  return previous.memory
+													  && previous.memory_type_bits == heap.memory_type_bits
+													  && previous.size >= heap.size;
+											  } );
+		if ( it != end( _heaps ) )
+		{
+			heap = std::move( *it );
+		}
+		else
+		{
+			heap.memory = _device->allocate_memory( vk::MemoryRequirements {
+				.size = heap.size, .alignment = heap_alignments[ index ], .memoryTypeBits = heap.memory_type_bits } );
+		}
+	}
+
+	std::vector<AliasedTexture> aliased;
+	aliased.reserve( requests.size() );
+	_statistics.requested_texture_memory = 0;
+	for ( uint32_t index = 0; index < requests.size(); ++index )
+	{
+		const auto& item = items[ index ];
+		const Placement placement { .desc = requests[ index ].desc,
+									.memory = heaps[ item.heap ].memory.get(),
+									.offset = item.offset,
+									.size = item.requirements.size };
+		_statistics.requested_texture_memory += placement.size;
+
+		// Textures with the same desc and disjoint lifetimes can end up at the same place, skip already reused ones
+		const auto it = std::ranges::find_if( _aliased,
+											  [ & ]( const AliasedTexture& previous )
+											  { return previous.placement == placement && previous.texture.get_image(); } );
+		if ( it != end( _aliased ) )
+		{
+			aliased.push_back( std::move( *it ) );
+			aliased.back().heap = item.heap;
+			*it = { };
+			continue;
+		}
+
+		auto texture = _device->create_aliased_texture( placement.desc, heaps[ item.heap ].memory, placement.offset );
+		const auto aspect
+			= placement.desc.format == Texture::Format::D32_SFLOAT ? TextureView::Aspect::DEPTH : TextureView::Aspect::COLOR;
+		auto view = _device->create_texture_view( texture, aspect );
+		aliased.push_back(
+			AliasedTexture { .placement = placement, .heap = item.heap, .texture = std::move( texture ), .view = std::move( view ) } );
+	}
+
+	// Previous frames may still use what wasn't reused
+	for ( auto& previous : _aliased )
+	{
+		if ( previous.texture.get_image() )
+		{
+			_device->queue_deletion( std::move( previous.view ) );
+			_device->queue_deletion( std::move( previous.texture ) );
+		}
+	}
+	for ( auto& previous : _heaps )
+	{
+		if ( previous.memory )
+		{
+			_device->queue_deletion( std::move( previous.memory ) );
+		}
+	}
+
+	_heaps = std::move( heaps );
+	_aliased = std::move( aliased );
+	_requests.assign( begin( requests ), end( requests ) );
+	_textures.clear();
+	for ( const auto& entry : _aliased )
+	{
+		_textures.push_back( entry.texture );
+	}
+
+	_statistics.textures = _aliased.size();
+	_statistics.texture_memory = 0;
+	for ( const auto& heap : _heaps )
+	{
+		_statistics.texture_memory += heap.size;
+	}
+	return _textures;
+}
+
+renderer::TextureView renderer::TransientPool::get_texture_view( uint32_t index ) const
+{
+	return _aliased[ index ].view;
+}
+
+void renderer::TransientPool::begin_lifetime( uint32_t index )
+{
+	auto& entry = _aliased[ index ];
+	auto& heap = _heaps[ entry.heap ];
+	const auto begin_offset = entry.placement.offset;
+	const auto end_offset = entry.placement.offset + entry.placement.size;
+
+	// Wait for everything that happened in that memory range. Content is discarded, reads only need an execution dependency.
+	AccessInfo previous = get_access_info( Access::NONE );
+	std::erase_if( heap.occupants,
+				   [ & ]( const Occupant& occupant )
+				   {
+					   if ( occupant.offset >= end_offset || begin_offset >= occupant.offset + occupant.size )
+					   {
+						   return false;
+					   }
+					   for ( const auto& mip : occupant.state->mips )
+					   {
+						   previous.stages |= mip.stages;
+						   if ( mip.is_write() )
+						   {
+							   previous.access |= mip.access;
+						   }
+					   }
+					   return true;
+				   } );
+
+	heap.occupants.push_back( Occupant { entry.placement.offset, entry.placement.size, entry.texture._state } );
+	std::ranges::fill( entry.texture._state->mips, previous );
+}
+
+renderer::TransientPool::PooledBuffer& renderer::TransientPool::acquire_buffer( Buffer::Usage usage, std::size_t size )
+{
+	BufferEntry* best = nullptr;
+	for ( auto& entry : _buffers )
+	{
+		if ( !entry->acquired && entry->buffer.get_usage() == usage && entry->buffer.get_size() >= size
+			 && ( !best || entry->buffer.get_size() < best->buffer.get_size() ) )
+		{
+			best = entry.get();
+		}
+	}
+
+	if ( !best )
+	{
+		auto buffer = _device->create_buffer( usage, size );
+		const renderer::Buffer handle = buffer;
+		best = _buffers.emplace_back( std::make_unique<BufferEntry>( BufferEntry { .buffer = std::move( buffer ), .pooled = { handle } } ) )
+				   .get();
+		_statistics.buffers = _buffers.size();
+	}
+	best->acquired = true;
+	return best->pooled;
+}
+
+void renderer::TransientPool::end_frame()
+{
+	for ( auto& entry : _buffers )
+	{
+		entry->unused_frames = entry->acquired ? 0 : entry->unused_frames + 1;
+		entry->acquired = false;
+		if ( entry->unused_frames > BUFFER_RELEASE_DELAY )
+		{
+			_device->queue_deletion( std::move( entry->buffer ) );
+		}
+	}
+	std::erase_if( _buffers, []( const auto& entry ) { return entry->unused_frames > BUFFER_RELEASE_DELAY; } );
+	_statistics.buffers = _buffers.size();
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <renderer/barrier.h>
+#include <renderer/buffer.h>
+#include <renderer/common.h>
+#include <renderer/texture.h>
+
+namespace renderer
+{
+	class Device;
+
+	// Textures and buffers that only live for part of a frame (render targets, intermediate buffers...).
+	// Resources are kept from one frame to the next and reused when requested with the same description.
+	class TransientPool
+	{
+	public:
+		struct TextureRequest
+		{
+			Texture::Desc desc;
+			// Inclusive range of the frame (eg: pass positions) during which the texture is used
+			uint32_t first_use = 0;
+			uint32_t last_use = 0;
+
+			bool operator==( const TextureRequest& other ) const = default;
+		};
+
+		struct PooledBuffer
+		{
+			Buffer buffer;
+			// Last access of the previous user, update it after recording so that the next one can wait for it
+			AccessInfo last_access;
+		};
+
+		struct Statistics
+		{
+			std::size_t texture_memory = 0; // Allocated, with aliasing
+			std::size_t requested_texture_memory = 0; // Without aliasing
+			uint32_t textures = 0;
+			uint32_t buffers = 0;
+		};
+
+		explicit TransientPool( Device& device );
+
+		// Places the textures of a frame in shared memory, textures with disjoint lifetimes may alias each other.
+		// Returned textures are valid until the next call. Requesting the same textures again (usual from one frame
+		// to the next) doesn't create anything.
+		std::span<const Texture> allocate_textures( std::span<const TextureRequest> requests );
+		// View of all mips, with the depth aspect for depth formats
+		TextureView get_texture_view( uint32_t index ) const;
+		// Call before recording the first use of a texture each frame, in submission order. Its content becomes undefined
+		// and the barrier of its first use waits for the previous textures that used the same memory.
+		void begin_lifetime( uint32_t index );
+
+		// Returns a buffer of at least the requested size that wasn't acquired since the last end_frame()
+		PooledBuffer& acquire_buffer( Buffer::Usage usage, std::size_t size );
+		// Makes buffers available again and releases the ones that weren't used for a while
+		void end_frame();
+
+		const Statistics& get_statistics() const { return _statistics; }
+
+	private:
+		struct Occupant
+		{
+			std::size_t offset;
+			std::size_t size;
+			std::shared_ptr<details::TextureState> state;
+		};
+
+		struct Heap
+		{
+			uint32_t memory_type_bits = 0;
+			std::size_t size = 0;
+			vma::raii::Memory memory;
+			// Last textures that used each range of the heap, in submission order
+			std::vector<Occupant> occupants;
+		};
+
+		struct Placement
+		{
+			Texture::Desc desc;
+			VmaAllocation memory;
+			std::size_t offset;
+			std::size_t size;
+
+			bool operator==( const Placement& other ) const = default;
+		};
+
+		struct AliasedTexture
+		{
+			Placement placement;
+			uint32_t heap;
+			raii::Texture texture;
+			raii::TextureView view;
+		};
+
+		struct BufferEntry
+		{
+			raii::Buffer buffer;
+			PooledBuffer pooled;
+			uint32_t unused_frames = 0;
+			bool acquired = false;
+		};
+
+		Device* _device;
+		std::vector<Heap> _heaps;
+		std::vector<TextureRequest> _requests;
+		std::vector<AliasedTexture> _aliased;
+		std::vector<Texture> _textures;
+		// Stable addresses, acquire_buffer() returns references
+		std::vector<std::unique_ptr<BufferEntry>> _buffers;
+		Statistics _statistics;
+	};
+}
@@ -0,0 +1,249 @@
+#include "upload_manager.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <ranges>
+#include <renderer/details/profiler.h>
+
+namespace
+{
+	// Enough for any texel or compressed block size and the 4 bytes required by buffer to image copies
+	constexpr std::size_t UPLOAD_ALIGNMENT = 16;
+
+	std::size_t align_up( std::size_t value, std::size_t alignment ) { return ( value + alignment - 1 ) / alignment * alignment; }
+}
+
+renderer::UploadManager::UploadManager( Device& device, std::size_t capacity )
+	: _device( &device )
+	, _staging( device.create_buffer( Buffer::Usage::TRANSFER_SRC, capacity, true ) )
+	, _mapped( static_cast<std::byte*>( _staging.get_mapped_address() ) )
+{
+}
+
+renderer::UploadManager::~UploadManager()
+{
+	// Don't throw from the destructor, pending copies that weren't flushed are lost
+	if ( !_batches.empty() )
+	{
+		try
+		{
+			wait_idle();
+		}
+		catch ( ... )
+		{
+		}
+	}
+}
+
+void renderer::UploadManager::upload( const Buffer& dest, std::size_t dest_offset, std::span<const std::byte> data, Access next_access )
+{
+	OPTICK_EVENT();
+	assert( dest_offset + data.size() <= dest.get_size() );
+	const auto offset = allocate( data.size() );
+	std::memcpy( _mapped + offset, data.data(), data.size() );
+
+	// Group copies to the same buffer into a single command
+	auto it = std::ranges::find_if( _buffer_copies,
+									[ & ]( const PendingBufferCopies& copies )
+									{ return copies.dest.get_buffer() == dest.get_buffer() && copies.next_access == next_access; } );
+	if ( it == end( _buffer_copies ) )
+	{
+		_buffer_copies.push_back( PendingBufferCopies { .dest = dest, .next_access = next_access } );
+		it = end( _buffer_copies ) - 1;
+	}
+	it->regions.push_back( BufferCopy { .src_offset = offset, .dst_offset = dest_offset, .size = data.size() } );
+}
+
+void renderer::UploadManager::upload( const Texture& dest, std::span<const std::byte> data, Access next_access )
+{
+	OPTICK_EVENT();
+	std::size_t expected_size = 0;
+	for ( int mip = 0; mip < dest.get_mips(); ++mip )
+	{
+		expected_size += dest.get_mip_size( mip );
+	}
+	if ( expected_size != data.size() )
+	{
+		throw Error( "Texture data size doesn't match its mips" );
+	}
+
+	const auto offset = allocate( data.size() );
+	std::memcpy( _mapped + offset, data.data(), data.size() );
+
+	PendingTextureCopies copies { .dest = dest, .next_access = next_access };
+	std::size_t mip_offset = offset;
+	for ( int mip = 0; mip < dest.get_mips(); ++mip )
+	{
+		copies.regions.push_back( BufferTextureCopy { .buffer_offset = mip_offset, .mip = mip } );
+		mip_offset += dest.get_mip_size( mip );
+	}
+	_texture_copies.push_back( std::move( copies ) );
+}
+
+void renderer::UploadManager::upload( const Texture& dest, int mip, std::span<const std::byte> data, Access next_access )
+{
+	upload( dest, mip, std::span( &data, 1 ), next_access );
+}
+
+void renderer::UploadManager::upload( const Texture& dest,
+									  int first_mip,
+									  std::span<const std::span<const std::byte>> mips,
+									  Access next_access )
+{
+	OPTICK_EVENT();
+	assert( first_mip + static_cast<int>( mips.size() ) <= dest.get_mips() );
+	std::size_t size = 0;
+	for ( std::size_t i = 0; i < mips.size(); ++i )
+	{
+		if ( dest.get_mip_size( first_mip + static_cast<int>( i ) ) != mips[ i ].size() )
+		{
+			throw Error( "Texture data size doesn't match its mip" );
+		}
+		size = align_up( size, UPLOAD_ALIGNMENT ) + mips[ i ].size();
+	}
+
+	const auto offset = allocate( size );
+	PendingTextureCopies copies { .dest = dest, .next_access = next_access };
+	std::size_t mip_offset = offset;
+	for ( std::size_t i = 0; i < mips.size(); ++i )
+	{
+		mip_offset = align_up( mip_offset, UPLOAD_ALIGNMENT );
+		std::memcpy( _mapped + mip_offset, mips[ i ].data(), mips[ i ].size() );
+		copies.regions.push_back( BufferTextureCopy { .buffer_offset = mip_offset, .mip = first_mip + static_cast<int>( i ) } );
+		mip_offset += mips[ i ].size();
+	}
+	_texture_copies.push_back( std::move( copies ) );
+}
+
+void renderer::UploadManager::flush()
+{
+	OPTICK_EVENT();
+	if ( _buffer_copies.empty() && _texture_copies.empty() )
+	{
+		return;
+	}
+	collect();
+
+	auto cmd = _device->grab_command_buffer();
+	cmd->begin();
+	for ( const auto& copies : _texture_copies )
+	{
+		cmd->copy_buffer_to_texture( _staging, copies.dest, copies.regions );
+	}
+	// Buffer state isn't tracked, so wait for whatever earlier submissions were doing with the destinations
+	// (write-after-read only needs an execution dependency)
+	const AccessInfo previous_uses { .stages = vk::PipelineStageFlagBits2::eAllCommands, .access = {} };
+	for ( const auto& copies : _buffer_copies )
+	{
+		cmd->barrier( copies.dest, previous_uses, get_access_info( Access::TRANSFER_WRITE ) );
+	}
+	for ( const auto& copies : _buffer_copies )
+	{
+		cmd->copy_buffer( _staging, copies.dest, copies.regions );
+	}
+	for ( const auto& copies : _buffer_copies )
+	{
+		cmd->barrier( copies.dest, Access::TRANSFER_WRITE, copies.next_access );
+	}
+	for ( const auto& copies : _texture_copies )
+	{
+		const auto [ first, last ] = std::ranges::minmax( copies.regions | std::views::transform( &BufferTextureCopy::mip ) );
+		cmd->use_texture( copies.dest, copies.next_access, { .base_mip = first, .mip_count = last - first + 1 } );
+	}
+	cmd->end();
+
+	raii::Fence fence = nullptr;
+	if ( _free_fences.empty() )
+	{
+		fence = _device->create_fence();
+	}
+	else
+	{
+		fence = std::move( _free_fences.back() );
+		_free_fences.pop_back();
+	}
+	_device->submit( *cmd, *fence );
+	_batches.push_back( Batch { .cmd = std::move( cmd ), .fence = std::move( fence ), .size = _pending_size } );
+	++_submitted_batches;
+
+	_pending_size = 0;
+	_buffer_copies.clear();
+	_texture_copies.clear();
+}
+
+void renderer::UploadManager::collect()
+{
+	while ( !_batches.empty() && _device->get_fence_status( *_batches.front().fence ) )
+	{
+		auto& batch = _batches.front();
+		_used -= batch.size;
+		_device->reset_fences( { *batch.fence } );
+		_free_fences.push_back( std::move( batch.fence ) );
+		_batches.pop_front();
+		++_completed_batches;
+	}
+}
+
+bool renderer::UploadManager::is_complete( uint64_t batch )
+{
+	collect();
+	return batch < _completed_batches;
+}
+
+void renderer::UploadManager::wait_idle()
+{
+	OPTICK_EVENT();
+	while ( !_batches.empty() )
+	{
+		wait_oldest();
+	}
+}
+
+void renderer::UploadManager::wait_oldest()
+{
+	_device->wait_for_fences( { *_batches.front().fence }, UINT64_MAX );
+	collect();
+}
+
+std::size_t renderer::UploadManager::allocate( std::size_t size )
+{
+	const auto capacity = _staging.get_size();
+	if ( size > capacity )
+	{
+		throw Error( "Upload doesn't fit in the staging buffer" );
+	}
+
+	// Allocations are contiguous, the end of the ring is skipped when it's too small
+	collect();
+	std::size_t offset = 0;
+	std::size_t consumed = 0;
+	while ( true )
+	{
+		if ( _used == 0 )
+		{
+			_head = 0;
+		}
+		offset = align_up( _head, UPLOAD_ALIGNMENT );
+		if ( offset + size > capacity )
+		{
+			offset = 0;
+		}
+		consumed = ( offset >= _head ? offset - _head : capacity - _head ) + size;
+		if ( _used + consumed <= capacity )
+		{
+			break;
+		}
+		if ( _batches.empty() )
+		{
+			// Ring is full of pending copies
+			flush();
+		}
+		wait_oldest();
+	}
+
+	_head = offset + size;
+	_used += consumed;
+	_pending_size += consumed;
+	return offset;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <deque>
+#include <renderer/barrier.h>
+#include <renderer/buffer.h>
+#include <renderer/command_buffer.h>
+#include <renderer/common.h>
+#include <renderer/device.h>
+#include <renderer/texture.h>
+
+namespace renderer
+{
+	// Uploads through a persistently mapped staging ring. Data is copied to the ring right away and GPU copies are
+	// batched into a single command buffer per flush(). Ring space is reclaimed once batches complete, without blocking
+	// unless the ring is full.
+	// Not thread safe. Call flush() before submitting command buffers using the uploaded resources.
+	class UploadManager
+	{
+	public:
+		explicit UploadManager( Device& device, std::size_t capacity = 64 * 1024 * 1024 );
+		~UploadManager();
+
+		UploadManager( const UploadManager& ) = delete;
+		UploadManager& operator=( const UploadManager& ) = delete;
+
+		// The buffer is made visible to next_access once the batch completes
+		void upload( const Buffer& dest,
+					 std::size_t dest_offset,
+					 std::span<const std::byte> data,
+					 Access next_access = Access::ANY_SHADER_READ );
+		// Data holds all mips, tightly packed, from the biggest to the smallest (see Texture::get_mip_size()).
+		// The texture is transitioned for next_access once copied, which bindless textures need since nothing else
+		// declares their uses. Texture state is tracked, other uses don't need an explicit barrier.
+		void upload( const Texture& dest, std::span<const std::byte> data, Access next_access = Access::ANY_SHADER_READ );
+		// A single mip, tightly packed (see Texture::get_mip_size())
+		void upload( const Texture& dest, int mip, std::span<const std::byte> data, Access next_access = Access::ANY_SHADER_READ );
+		// Consecutive mips starting at first_mip, one span each, copied with a single command
+		void upload( const Texture& dest,
+					 int first_mip,
+					 std::span<const std::span<const std::byte>> mips,
+					 Access next_access = Access::ANY_SHADER_READ );
+
+		// Submits pending copies, no-op if there are none
+		void flush();
+		// Reclaims ring space of completed batches, never blocks
+		void collect();
+		// Blocks until all submitted batches are complete
+		void wait_idle();
+		// Batch the uploads queued so far will be submitted with, see is_complete()
+		uint64_t get_pending_batch() const { return _submitted_batches; }
+		// Whether a batch has completed on the GPU, never blocks
+		bool is_complete( uint64_t batch );
+
+		std::size_t get_capacity() const { return _staging.get_size(); }
+		std::size_t get_used_size() const { return _used; }
+
+	private:
+		struct PendingBufferCopies
+		{
+			Buffer dest;
+			Access next_access;
+			std::vector<BufferCopy> regions;
+		};
+
+		struct PendingTextureCopies
+		{
+			Texture dest;
+			Access next_access;
+			std::vector<BufferTextureCopy> regions;
+		};
+
+		struct Batch
+		{
+			raii::CommandBuffer cmd;
+			raii::Fence fence;
+			std::size_t size; // Ring space, including padding
+		};
+
+		// Returns offset of a free ring range, waits for older batches if there is not enough space
+		std::size_t allocate( std::size_t size );
+		void wait_oldest();
+
+		Device* _device;
+		raii::Buffer _staging;
+		std::byte* _mapped;
+		std::size_t _head = 0;
+		std::size_t _used = 0;
+		std::size_t _pending_size = 0;
+		std::vector<PendingBufferCopies> _buffer_copies;
+		std::vector<PendingTextureCopies> _texture_copies;
+		std::deque<Batch> _batches;
+		uint64_t _submitted_batches = 0;
+		uint64_t _completed_batches = 0;
+		std::vector<raii::Fence> _free_fences;
+	};
+}